@@ -0,0 +1,591 @@
+// tracey benchmarks. build it like the samples, preferably with optimizations:
+// g++ bench.cc tracey.cpp -O2 -g -lpthread -std=c++11 -o bench && ./bench [name]
+// tweak tracey.hpp settings and rebuild to compare configurations.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include "tracey.hpp"
+
+namespace {
+
+    double now() {
+        return std::chrono::duration<double>( std::chrono::high_resolution_clock::now().time_since_epoch() ).count();
+    }
+
+    long peak_rss_kb() {
+#ifndef _WIN32
+        struct rusage ru;
+        if( getrusage( RUSAGE_SELF, &ru ) == 0 ) return ru.ru_maxrss;
+#endif
+        return 0;
+    }
+
+    // every thread keeps a small window of live allocations, so the registry sees a mix of inserts and removals
+    void churn( unsigned ops ) {
+        enum { window = 64 };
+        char *live[ window ] = {};
+        for( unsigned i = 0; i < ops; ++i ) {
+            char *&slot = live[ i % window ];
+            delete [] slot;
+            slot = new char [ 16 + (i % 8) * 16 ];
+        }
+        for( unsigned i = 0; i < window; ++i ) {
+            delete [] live[ i ];
+        }
+    }
+
+    void bench_threads() {
+        printf("threads: scaling of new/delete pairs across threads (kTraceyRegistryShards=%d)\n", int(kTraceyRegistryShards));
+        const unsigned ops = 20000;
+        unsigned max_threads = std::thread::hardware_concurrency() * 2;
+        if( max_threads < 32 ) max_threads = 32;
+        for( unsigned n = 1; n <= max_threads; n *= 2 ) {
+            double t0 = now();
+            std::vector<std::thread> pool;
+            for( unsigned i = 0; i < n; ++i ) {
+                pool.push_back( std::thread( churn, ops ) );
+            }
+            for( unsigned i = 0; i < n; ++i ) {
+                pool[i].join();
+            }
+            double dt = now() - t0;
+            printf("\t%2u threads: %8.0f ns/op, %8.3f Mops/s\n", n, dt * 1e9 / ops, (n * ops) / dt / 1e6);
+        }
+    }
+
+    // allocating threads while a monitor polls summary() as fast as it can; stats reads should not slow them down
+    volatile bool polling;
+    void poll_summary() {
+        while( polling ) {
+            tracey::summary();
+        }
+    }
+
+    void bench_summary() {
+        printf("summary: new/delete pairs in 4 threads, with and without a thread polling summary()\n");
+        const unsigned ops = 20000, n = 4;
+        for( unsigned poll = 0; poll < 2; ++poll ) {
+            polling = poll != 0;
+            std::thread monitor( poll_summary );
+            double t0 = now();
+            std::vector<std::thread> pool;
+            for( unsigned i = 0; i < n; ++i ) {
+                pool.push_back( std::thread( churn, ops ) );
+            }
+            for( unsigned i = 0; i < n; ++i ) {
+                pool[i].join();
+            }
+            double dt = now() - t0;
+            polling = false;
+            monitor.join();
+            printf("\t%s: %8.0f ns/op\n", poll ? "polling" : "idle   ", dt * 1e9 / ( n * ops ));
+        }
+    }
+
+    // a large live set: the registry has to keep millions of records while inserting and removing
+    void bench_live() {
+        const unsigned n = 1000000;
+        printf("live: %u live allocations (kTraceyInbandHeaders=%d)\n", n, int(kTraceyInbandHeaders));
+        std::vector<int *> ptrs( n );
+        double t0 = now();
+        for( unsigned i = 0; i < n; ++i ) {
+            ptrs[i] = new int;
+        }
+        double t1 = now();
+        for( unsigned i = 0; i < n; ++i ) {
+            delete ptrs[i];
+        }
+        double t2 = now();
+        printf("\tnew: %8.0f ns/op, delete: %8.0f ns/op, peak rss: %ld KB\n", (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / n, peak_rss_kb());
+    }
+
+    // what a caller of operator new/delete waits for. calls are timed in small batches, as clocks can be coarse.
+    void bench_latency() {
+        printf("latency: per-call cost of new/delete (kTraceyAsyncTracking=%d, kTraceyInbandHeaders=%d)\n", int(kTraceyAsyncTracking), int(kTraceyInbandHeaders));
+        enum { batch = 8 };
+        const unsigned n = 50000;
+        std::vector<double> news( n ), deletes( n );
+        char *volatile ptrs[ batch ];
+        for( unsigned i = 0; i < n; ++i ) {
+            double t0 = now();
+            for( unsigned j = 0; j < batch; ++j ) ptrs[j] = new char [ 32 ];
+            double t1 = now();
+            for( unsigned j = 0; j < batch; ++j ) delete [] ptrs[j];
+            double t2 = now();
+            news[i] = ( t1 - t0 ) / batch;
+            deletes[i] = ( t2 - t1 ) / batch;
+        }
+        std::sort( news.begin(), news.end() );
+        std::sort( deletes.begin(), deletes.end() );
+        printf("\tnew:    p50 %6.0f ns, p99 %6.0f ns\n", news[n / 2] * 1e9, news[n * 99 / 100] * 1e9);
+        printf("\tdelete: p50 %6.0f ns, p99 %6.0f ns\n", deletes[n / 2] * 1e9, deletes[n * 99 / 100] * 1e9);
+    }
+
+    char *volatile block;
+
+    // allocations that tracey does not track (made while tracey is disabled, or nested inside tracey itself) all return
+    // at the same early checks, before any lock. compared against plain malloc/free and tracked new/delete.
+    void bench_nested() {
+        printf("nested: per-pair cost of untracked new/delete (kTraceySpinlocks=%d)\n", int(kTraceySpinlocks));
+        const unsigned n = 1000000;
+        double t0 = now();
+        for( unsigned i = 0; i < n; ++i ) {
+            block = (char *)malloc( 32 );
+            free( block );
+        }
+        double t1 = now();
+        tracey::disable();
+        for( unsigned i = 0; i < n; ++i ) {
+            block = new char [ 32 ];
+            delete [] block;
+        }
+        double t2 = now();
+        tracey::enable();
+        for( unsigned i = 0; i < n / 100; ++i ) {
+            block = new char [ 32 ];
+            delete [] block;
+        }
+        double t3 = now();
+        printf("\tmalloc/free: %6.1f ns, untracked new/delete: %6.1f ns, tracked new/delete: %8.1f ns\n",
+            (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / n, (t3 - t2) * 1e9 / (n / 100));
+    }
+
+    // allocations at the end of call chains of given depth, so unwinding dominates
+    volatile unsigned sink;
+    int *deep( unsigned depth ) {
+        int *p = depth ? deep( depth - 1 ) : new int;
+        sink = sink + 1; // no tail calls
+        return p;
+    }
+
+    void bench_capture() {
+        printf("capture: new/delete pairs from deep call chains (kTraceyUnwinder=%d)\n", int(kTraceyUnwinder));
+        const unsigned n = 20000, depths[] = { 8, 32, 96 };
+        for( unsigned d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d ) {
+            double t0 = now();
+            for( unsigned i = 0; i < n; ++i ) {
+                delete deep( depths[d] );
+            }
+            double dt = now() - t0;
+            printf("\t%2u frames deep: %8.0f ns/op\n", depths[d], dt * 1e9 / n);
+        }
+    }
+
+    // tracking cost against sampling interval (0 tracks everything), and how close the estimates get
+    void bench_sampling() {
+        printf("sampling: new/delete pairs, with 1/3 of them kept alive, per sampling interval\n");
+        const unsigned n = 200000;
+        const size_t intervals[] = { 0, 4096, 65536, 1 << 20 };
+        std::vector<char *> keep;
+        keep.reserve( n );
+        for( unsigned k = 0; k < sizeof(intervals) / sizeof(intervals[0]); ++k ) {
+            tracey::sampling( intervals[k] );
+            size_t bytes = 0;
+            double t0 = now();
+            for( unsigned i = 0; i < n; ++i ) {
+                size_t size = 16 + (i % 64) * 24;
+                char *p = new char [ size ];
+                if( i % 3 ) delete [] p; else keep.push_back( p ), bytes += size;
+            }
+            double dt = now() - t0;
+            printf("\t%7u bytes: %8.0f ns/op, %zu KB live: %s\n", unsigned(intervals[k]), dt * 1e9 / n, bytes / 1024, tracey::summary().c_str());
+            for( size_t i = 0; i < keep.size(); ++i ) {
+                delete [] keep[i];
+            }
+            keep.clear();
+        }
+        tracey::sampling( kTraceySamplingInterval );
+    }
+
+    // every instantiation is a distinct allocating function, so reports have that many unique frames to resolve
+    enum { num_sites = 1024 };
+    typedef void (*site)( std::vector<int *> &live );
+    void keep( std::vector<int *> &live, int *p ) {
+        live.push_back( p );
+    }
+    template<unsigned N>
+    void run_site( std::vector<int *> &live ) {
+        keep( live, new int );
+        sink = sink + N; // distinct code, no folding
+    }
+    template<unsigned LO, unsigned HI>
+    struct sites {
+        static void fill( site *table ) {
+            sites<LO, (LO + HI) / 2>::fill( table );
+            sites<(LO + HI) / 2, HI>::fill( table );
+        }
+    };
+    template<unsigned LO>
+    struct sites<LO, LO + 1> {
+        static void fill( site *table ) {
+            table[ LO ] = run_site<LO>;
+        }
+    };
+
+    void bench_symbolize() {
+        printf("symbolize: report of allocations from %d distinct functions (kTraceySymbolizerThreads=%d)\n", int(num_sites), int(kTraceySymbolizerThreads));
+        std::vector<site> table( num_sites );
+        sites<0, num_sites>::fill( &table[0] );
+        std::vector<int *> live;
+        for( unsigned i = 0; i < num_sites; ++i ) {
+            table[i]( live );
+        }
+        double t0 = now();
+        std::string report = tracey::report();
+        double dt = now() - t0;
+        printf("\treport: %8.1f ms (%s)\n", dt * 1e3, report.c_str());
+        for( size_t i = 0; i < live.size(); ++i ) {
+            delete live[i];
+        }
+    }
+
+    // what a production process pays for a heap snapshot, against a full report
+    void bench_dump() {
+        printf("dump: snapshot of %d live allocations from %d distinct functions\n", int(num_sites) * 100, int(num_sites));
+        std::vector<site> table( num_sites );
+        sites<0, num_sites>::fill( &table[0] );
+        std::vector<int *> live;
+        for( unsigned n = 0; n < 100; ++n ) {
+            for( unsigned i = 0; i < num_sites; ++i ) {
+                table[i]( live );
+            }
+        }
+        const char *path = "bench-dump.tracey";
+        double t0 = now();
+        bool ok = tracey::dump( path );
+        double t1 = now();
+        tracey::report();
+        double t2 = now();
+        printf("\tdump: %8.1f ms (%s), report: %8.1f ms\n", (t1 - t0) * 1e3, ok ? "ok" : "failed", (t2 - t1) * 1e3);
+        remove( path );
+        for( size_t i = 0; i < live.size(); ++i ) {
+            delete live[i];
+        }
+    }
+
+    // a few functions calling each other along every path of a binary tree: many distinct deep stacks, few frames to resolve
+    void descend( std::vector<int *> &live, unsigned path, unsigned depth );
+    void left( std::vector<int *> &live, unsigned path, unsigned depth ) {
+        descend( live, path, depth );
+        sink = sink + 1;
+    }
+    void right( std::vector<int *> &live, unsigned path, unsigned depth ) {
+        descend( live, path, depth );
+        sink = sink + 2;
+    }
+    void (*volatile turns[2])( std::vector<int *> &, unsigned, unsigned ) = { left, right }; // opaque calls, no inlining
+    void descend( std::vector<int *> &live, unsigned path, unsigned depth ) {
+        if( !depth ) {
+            live.push_back( new int );
+            return;
+        }
+        turns[ path & 1 ]( live, path >> 1, depth - 1 );
+    }
+
+    void bench_tree() {
+        enum { depth = 14 };
+        printf("tree: report of %d distinct callstacks, %d frames deep\n", 1 << depth, depth * 2);
+        std::vector<int *> live;
+        for( unsigned n = 0; n < 4; ++n ) {
+            for( unsigned i = 0; i < (1u << depth); ++i ) {
+                descend( live, i, depth );
+            }
+        }
+        double t0 = now();
+        std::string report = tracey::report();
+        double dt = now() - t0;
+        printf("\treport: %8.1f ms (%s)\n", dt * 1e3, report.c_str());
+        for( size_t i = 0; i < live.size(); ++i ) {
+            delete live[i];
+        }
+    }
+
+    // how long another thread cannot allocate while a big report is made
+    std::atomic<bool> reporting;
+    std::atomic<unsigned> allocations;
+    void allocate_while_reporting( double *worst ) {
+        while( reporting ) {
+            double t0 = now();
+            int *volatile p = new int;
+            delete p;
+            double dt = now() - t0;
+            if( dt > *worst ) *worst = dt;
+            ++allocations;
+        }
+    }
+    void bench_stall() {
+        enum { depth = 14 };
+        printf("stall: longest new/delete on another thread during a report of %d distinct callstacks\n", 1 << depth);
+        std::vector<int *> live;
+        for( unsigned i = 0; i < (1u << depth); ++i ) {
+            descend( live, i, depth );
+        }
+        double worst = 0;
+        reporting = true;
+        std::thread other( allocate_while_reporting, &worst );
+        while( !allocations ) std::this_thread::yield();
+        double t0 = now();
+        tracey::report();
+        double dt = now() - t0;
+        unsigned during = allocations;
+        reporting = false;
+        other.join();
+        printf("\treport: %8.1f ms, longest stall: %8.1f ms, %u allocations meanwhile\n", dt * 1e3, worst * 1e3, during);
+        for( size_t i = 0; i < live.size(); ++i ) {
+            delete live[i];
+        }
+    }
+
+    // how long tracey::report() pauses its caller, against how long the report takes to be written.
+    // a forked report returns as soon as the child runs, while the child is still writing.
+    bool complete( const std::string &path ) {
+        FILE *fp = fopen( path.c_str(), "rb" );
+        if( !fp ) return false;
+        char tail[ 32 ] = {};
+        fseek( fp, -20, SEEK_END );
+        size_t len = fread( tail, 1, sizeof(tail) - 1, fp );
+        fclose( fp );
+        return len && strstr( tail, "</html>" );
+    }
+    void bench_fork() {
+        enum { depth = 14 };
+        printf("fork: report of %d distinct callstacks and 1 GB of live heap (kTraceyForkReports=%d)\n", 1 << depth, int(kTraceyForkReports));
+        std::vector<int *> live;
+        for( unsigned i = 0; i < (1u << depth); ++i ) {
+            descend( live, i, depth );
+        }
+        std::vector<char *> heap;
+        for( unsigned i = 0; i < 1024; ++i ) {
+            heap.push_back( new char[ 1 << 20 ] );
+            memset( heap.back(), 1, 1 << 20 );
+        }
+        double t0 = now();
+        std::string path = tracey::report();
+        double t1 = now();
+        while( !complete( path ) ) std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        double t2 = now();
+        printf("\tcaller paused: %8.1f ms, report written: %8.1f ms\n", (t1 - t0) * 1e3, (t2 - t0) * 1e3);
+        remove( path.c_str() );
+        for( size_t i = 0; i < heap.size(); ++i ) {
+            delete [] heap[i];
+        }
+        for( size_t i = 0; i < live.size(); ++i ) {
+            delete live[i];
+        }
+    }
+
+    // cost of scoping a small unit of work while a big heap is live: clear() and a report of the scope's leaks
+    int discard( const char *, size_t len, void * ) {
+        return len > 0;
+    }
+    void bench_scope() {
+        enum { live_count = 1000000, scoped = 100, rounds = 100 };
+        printf("scope: clear() and report of %d scoped leaks, with %d older allocations live\n", int(scoped), int(live_count));
+        std::vector<int *> live( live_count ), leaks;
+        for( size_t i = 0; i < live.size(); ++i ) {
+            live[i] = new int;
+        }
+        leaks.reserve( scoped * rounds );
+        double cleared = 0, reported = 0;
+        for( unsigned r = 0; r < rounds; ++r ) {
+            double t0 = now();
+            tracey::clear();
+            double t1 = now();
+            for( unsigned i = 0; i < scoped; ++i ) {
+                leaks.push_back( new int );
+            }
+            double t2 = now();
+            tracey::report( discard, 0 );
+            double t3 = now();
+            cleared += t1 - t0, reported += t3 - t2;
+        }
+        printf("\tclear: %8.3f ms, report: %8.3f ms\n", cleared / rounds * 1e3, reported / rounds * 1e3);
+        for( size_t i = 0; i < live.size(); ++i ) {
+            delete live[i];
+        }
+        for( size_t i = 0; i < leaks.size(); ++i ) {
+            delete leaks[i];
+        }
+    }
+
+    // request handlers on several threads, each one in its own scope, with a big heap live meanwhile
+    void handle_requests( unsigned requests, double *scoping ) {
+        double spent = 0;
+        for( unsigned r = 0; r < requests; ++r ) {
+            double t0 = now();
+            tracey::thread_scope request;
+            double t1 = now();
+            int *volatile p[ 8 ];
+            for( unsigned i = 0; i < 8; ++i ) p[i] = new int;
+            for( unsigned i = 0; i < 7; ++i ) delete p[i];
+            if( request.usage().survivors != 1 ) printf("\tunexpected survivors\n");
+            delete p[7];
+            spent += t1 - t0;
+        }
+        *scoping = spent;
+    }
+    void bench_scopes() {
+        enum { live_count = 1000000, requests = 20000, n = 4 };
+        printf("scopes: %d threads entering a scope per request, with %d other allocations live\n", int(n), int(live_count));
+        std::vector<int *> live( live_count );
+        for( size_t i = 0; i < live.size(); ++i ) {
+            live[i] = new int;
+        }
+        double t0 = now(), spent[ n ];
+        std::vector<std::thread> pool;
+        for( unsigned i = 0; i < n; ++i ) {
+            pool.push_back( std::thread( handle_requests, unsigned( requests ), &spent[i] ) );
+        }
+        for( unsigned i = 0; i < n; ++i ) {
+            pool[i].join();
+        }
+        double dt = now() - t0, entry = 0;
+        for( unsigned i = 0; i < n; ++i ) entry += spent[i];
+        printf("\tscope entry: %8.0f ns, request: %8.0f ns\n", entry * 1e9 / ( n * requests ), dt * 1e9 / ( n * requests ) );
+        for( size_t i = 0; i < live.size(); ++i ) {
+            delete live[i];
+        }
+    }
+
+    // a hot loop guarded by a no-alloc zone: entry and exit of a clean zone, and a zone that records one violation
+    void bench_zones() {
+        printf("zones: per-iteration cost of a no-alloc zone\n");
+        const unsigned n = 1000000;
+        volatile unsigned sum = 0;
+        double t0 = now();
+        for( unsigned i = 0; i < n; ++i ) {
+            sum += i;
+        }
+        double t1 = now();
+        for( unsigned i = 0; i < n; ++i ) {
+            tracey::no_alloc_zone zone;
+            sum += i;
+        }
+        double t2 = now();
+        for( unsigned i = 0; i < n / 100; ++i ) {
+            tracey::no_alloc_zone zone;
+            block = new char [ 32 ];
+            delete [] block;
+        }
+        double t3 = now();
+        printf("\tclean: %8.1f ns (bare loop: %.1f ns), with a violation: %8.0f ns\n", ( t2 - t1 ) * 1e9 / n, ( t1 - t0 ) * 1e9 / n, ( t3 - t2 ) * 1e9 / ( n / 100 ));
+    }
+
+    // a benchmark loop measured with a counting-only counter: allocations are counted per thread, with no capture.
+    // compared against untracked new/delete (tracey disabled), so the difference is the cost of counting.
+    void bench_counter() {
+        printf("counter: per-pair cost of new/delete in a counting-only counter\n");
+        const unsigned n = 1000000;
+        tracey::disable();
+        double t0 = now();
+        for( unsigned i = 0; i < n; ++i ) {
+            block = new char [ 32 ];
+            delete [] block;
+        }
+        double t1 = now();
+        tracey::enable();
+        tracey::counter counter;
+        for( unsigned i = 0; i < n; ++i ) {
+            block = new char [ 32 ];
+            delete [] block;
+        }
+        double t2 = now();
+        printf("\tuntracked new/delete: %6.1f ns, counted new/delete: %6.1f ns (%.2f allocations, %.1f bytes per iteration)\n",
+            ( t1 - t0 ) * 1e9 / n, ( t2 - t1 ) * 1e9 / n, counter.allocations_per( n ), counter.bytes_per( n ));
+    }
+
+    // the first operator new of a process starts tracey. it is timed before main, and child processes print it
+    double first_allocation() {
+        double t0 = now();
+        int *volatile p = new int;
+        double t1 = now();
+        delete p;
+        return t1 - t0;
+    }
+    const double first_allocation_time = first_allocation();
+
+    // what a short-lived process pays for tracey: its first allocation, timed in a child process
+    const char *self;
+    void bench_startup() {
+        printf("startup: time of the first allocation of a process\n");
+        const unsigned n = 10;
+        std::string cmd = std::string("\"") + self + "\" --first-allocation";
+#ifdef _WIN32
+        cmd += " 2> NUL";
+#else
+        cmd += " 2> /dev/null";
+#endif
+        std::vector<double> runs( n );
+        for( unsigned i = 0; i < n; ++i ) {
+#ifdef _WIN32
+            FILE *fp = _popen( cmd.c_str(), "r" );
+#else
+            FILE *fp = popen( cmd.c_str(), "r" );
+#endif
+            char line[ 256 ];
+            runs[i] = 0;
+            while( fp && fgets( line, sizeof(line), fp ) ) {
+                sscanf( line, "first allocation: %lf", &runs[i] ); // tracey prints its settings meanwhile
+            }
+#ifdef _WIN32
+            if( fp ) _pclose( fp );
+#else
+            if( fp ) pclose( fp ); // tracey quits with a nonzero status (see kTraceyDie)
+#endif
+        }
+        std::sort( runs.begin(), runs.end() );
+        printf("\tp50 %8.1f us, max %8.1f us\n", runs[n / 2] * 1e6, runs[n - 1] * 1e6);
+    }
+
+    struct entry {
+        const char *name;
+        void (*fn)();
+    } benches[] = {
+        { "threads", bench_threads },
+        { "summary", bench_summary },
+        { "live", bench_live },
+        { "latency", bench_latency },
+        { "capture", bench_capture },
+        { "nested", bench_nested },
+        { "sampling", bench_sampling },
+        { "startup", bench_startup },
+        { "symbolize", bench_symbolize },
+        { "dump", bench_dump },
+        { "tree", bench_tree },
+        { "stall", bench_stall },
+        { "fork", bench_fork },
+        { "scope", bench_scope },
+        { "scopes", bench_scopes },
+        { "zones", bench_zones },
+        { "counter", bench_counter },
+    };
+}
+
+int main( int argc, const char **argv ) {
+    if( argc > 1 && !strcmp( argv[1], "--first-allocation" ) ) {
+        printf("first allocation: %.9f\n", first_allocation_time);
+        fflush( stdout );
+        tracey::disable();
+        return 0;
+    }
+    self = argv[0];
+
+    for( unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i ) {
+        if( argc < 2 || !strcmp( argv[1], benches[i].name ) ) {
+            benches[i].fn();
+            fflush( stdout );
+        }
+    }
+
+    tracey::disable(); // do not show final report on exit
+}
@@ -0,0 +1,40 @@
+// tracey-cli: renders heap snapshots written by tracey::dump(), possibly on another machine that has the debug info.
+// build it like the samples: g++ tracey-cli.cc tracey.cpp -O2 -lpthread -std=c++11 -o tracey-cli
+// usage: tracey-cli snapshot output.txt [debug-dir]
+// modules are looked up by build-id in debug-dir/.build-id, then as debug-dir/<name>, at their original path,
+// and in /usr/lib/debug/.build-id. the output goes to a file, since tracey itself may log to stdout.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "tracey.hpp"
+
+// tracey ends the process on its own at exit, so the status is set here
+static int quit( int status ) {
+    fflush( stdout );
+    fflush( stderr );
+    _Exit( status );
+}
+
+int main( int argc, const char **argv ) {
+    // the tool itself is not under test
+    tracey::disable();
+
+    if( argc < 3 ) {
+        fprintf( stderr, "usage: %s snapshot output.txt [debug-dir]\n", argv[0] );
+        return quit( 1 );
+    }
+
+    std::string text = tracey::render( argv[1], argc > 3 ? argv[3] : "" );
+    if( text.empty() ) {
+        fprintf( stderr, "%s: cannot read snapshot '%s'\n", argv[0], argv[1] );
+        return quit( 1 );
+    }
+
+    FILE *fp = fopen( argv[2], "wb" );
+    if( !fp || fwrite( text.data(), 1, text.size(), fp ) != text.size() || fclose( fp ) ) {
+        fprintf( stderr, "%s: cannot write '%s'\n", argv[0], argv[2] );
+        return quit( 1 );
+    }
+    return quit( 0 );
+}
@@ -75,6 +75,7 @@
 
 #include <cassert>
 #include <cctype>
+#include <cmath>
 // #include <cstddef> // (stddef.h fails on ArchLinux w/ clang 3.4)
 #include <cstdio>
 #include <cstdlib>
@@ -419,6 +420,50 @@ namespace oak
 
 // external; macros, OS utils. Here is where the fun starts {
 #   define HEAL_MAX_TRACES kTraceyMaxStacktraces
+#   define HEAL_UNWINDER kTraceyUnwinder
+#   define HEAL_SYMBOL_CACHE kTraceySymbolCache
+#   define HEAL_SYMBOLIZER_THREADS kTraceySymbolizerThreads
+#   define HEAL_THREAD_PROLOGUE() tracey::untracked_thread()
+#   define HEAL_ALLOCATOR tracey::arena_allocator
+namespace tracey {
+	void untracked_thread();
+	void *allocate_metadata( size_t bytes );
+	void release_metadata( void *ptr, size_t bytes );
+
+	// STL allocator over tracey's own heap (see arena), for its own containers
+	template<typename T>
+	struct arena_allocator {
+		typedef T value_type;
+		typedef T *pointer;
+		typedef const T *const_pointer;
+		typedef T &reference;
+		typedef const T &const_reference;
+		typedef size_t size_type;
+		typedef ptrdiff_t difference_type;
+		template<typename U> struct rebind { typedef arena_allocator<U> other; };
+
+		arena_allocator() {}
+		template<typename U> arena_allocator( const arena_allocator<U> & ) {}
+
+		T *allocate( size_t n, const void * = 0 ) {
+			return (T *)allocate_metadata( n * sizeof(T) );
+		}
+		void deallocate( T *p, size_t n ) {
+			release_metadata( p, n * sizeof(T) );
+		}
+		size_t max_size() const {
+			return size_t(~0) / sizeof(T);
+		}
+		void construct( T *p, const T &v ) {
+			new ((void *)p) T( v );
+		}
+		void destroy( T *p ) {
+			p->~T();
+		}
+		template<typename U> bool operator==( const arena_allocator<U> & ) const { return true; }
+		template<typename U> bool operator!=( const arena_allocator<U> & ) const { return false; }
+	};
+}
 #   define heal tracey_heal
 
 //#line 1 "heal.cpp"
@@ -472,6 +517,7 @@ namespace oak
 #   include <windows.h>
 #   include <commctrl.h>
 #   pragma comment(lib, "comctl32.lib")
+#   include <io.h>
 #   if defined _M_IX86
 #       pragma comment(linker, "/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='x86' publicKeyToken='6595b64144ccf1df' language='*'\"")
 #   elif defined _M_IA64
@@ -495,6 +541,17 @@ namespace oak
 #   include <signal.h>
 #   include <sys/time.h>
 #   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <sys/mman.h>
+#   include <sys/file.h>
+#   include <fcntl.h>
+#   include <errno.h>
+#   include <pthread.h>
+#   include <sys/wait.h>
+#   ifdef __linux__
+#       include <elf.h>
+#       include <link.h>
+#   endif
 //  --
 #   if defined(HAVE_SYS_SYSCTL_H) && \
 		!defined(_SC_NPROCESSORS_ONLN) && !defined(_SC_NPROC_ONLN)
@@ -549,6 +606,7 @@ namespace std {
 #   include <functional>       // else assume modern c++11 and use std::function<> instead
 #   include <mutex>            // and std::mutex
 #   include <thread>           // and std::thread
+#   include <atomic>           // and std::atomic
 #   include <cstdint>
 #endif
 
@@ -782,12 +840,34 @@ namespace heal {
 	#define HEAL_MAX_TRACES 128
 	#endif
 
+	#ifndef HEAL_UNWINDER
+	#define HEAL_UNWINDER 0 // 0: system unwinder, 1: frame pointers
+	#endif
+
+	#ifndef HEAL_SYMBOL_CACHE
+	#define HEAL_SYMBOL_CACHE "" // directory of persistent symbols, if any
+	#endif
+
+	#ifndef HEAL_SYMBOLIZER_THREADS
+	#define HEAL_SYMBOLIZER_THREADS 0 // 0: all cores
+	#endif
+
+	#ifndef HEAL_THREAD_PROLOGUE
+	#define HEAL_THREAD_PROLOGUE() // run by every helper thread heal starts
+	#endif
+
+	#ifndef HEAL_ALLOCATOR
+	#define HEAL_ALLOCATOR std::allocator // of heal's own lookup tables
+	#endif
+
 	struct callstack /* : public std::vector<const void*> */ {
 		enum { max_frames = HEAL_MAX_TRACES };
 		std::vector<void *> frames;
 		callstack( bool autosave = false );
 		size_t space() const;
 		void save( unsigned frames_to_skip = 0 );
+		// captures return addresses of calling thread into given buffer, and returns how many. allocates nothing.
+		static unsigned capture( void **out, unsigned capacity, unsigned frames_to_skip = 0 );
 		std::vector<std::string> unwind( unsigned from = 0, unsigned to = ~0 ) const;
 		std::vector<std::string> str( const char *format12 = "#\1 \2\n", size_t skip_begin = 0 ) const;
 		std::string flat( const char *format12 = "#\1 \2\n", size_t skip_begin = 0 ) const;
@@ -803,6 +883,16 @@ namespace heal {
 	}
 
 	std::string demangle( const std::string &mangled );
+
+	// resolves link-time addresses of a module file (or of its separate debug file), possibly offline.
+	// fails if the file cannot be read, or if a build-id (hex) is given and the file does not match it.
+	bool symbolize( const std::string &module, const std::string &build_id, const std::vector<uintptr_t> &addresses, std::vector<std::string> &out );
+	// run by a forked child, which has no other threads: drops the symbolizer state if the parent was busy with it,
+	// and resolves without helper threads from then on
+	void forked_symbolizer();
+	// holds the unwinder state still, e.g. across fork()
+	void lock_unwinder();
+	void unlock_unwinder();
 	std::vector<std::string> stacktrace( const char *format12 = "#\1 \2\n", size_t skip_initial = 0 );
 	std::string stackstring( const char *format12 = "#\1 \2\n", size_t skip_initial = 0 );
 
@@ -1472,19 +1562,17 @@ std::string demangle( const std::string &mangled ) {
 		pclose(fp);
 		return demangled;
 		)
-		$yes( /* addr2line way. wip & quick proof-of-concept. clean up required. */
-		heal::sfstring binary = mangled.substr( 0, mangled.find_first_of('(') );
-		heal::sfstring address = mangled.substr( mangled.find_last_of('[') + 1 );
-		address.pop_back();
-		heal::sfstring cmd( "addr2line -e \1 \2", binary, address );
-		FILE *fp = popen( cmd.c_str(), "r" );
-		if (!fp) { return mangled; }
-		char demangled[1024];
-		char *line_p = fgets(demangled, sizeof(demangled), fp);
-		pclose(fp);
-		heal::sfstring demangled_(demangled);
-		if( demangled_.size() ) demangled_.pop_back(); //remove \n
-		return demangled_.size() && demangled_.at(0) == '?' ? mangled : demangled_;
+		$yes( /* backtrace_symbols() way: "binary(function+offset) [address]". no child processes. */
+		std::string::size_type open = mangled.find_first_of('('), plus = mangled.find_first_of("+)", open);
+		if( open == std::string::npos || plus == std::string::npos || plus == open + 1 ) {
+			return mangled;
+		}
+		std::string binary = mangled.substr( 0, open ), funcname = mangled.substr( open + 1, plus - open - 1 );
+		int status = 0;
+		char *demangled = abi::__cxa_demangle(funcname.c_str(), NULL, NULL, &status);
+		heal::sfstring out( "\1 ([\2])", status == 0 && demangled ? demangled : funcname.c_str(), binary );
+		if( demangled ) free( demangled );
+		return out;
 		)
 	})
 	$windows({
@@ -1506,849 +1594,2017 @@ std::string demangle( const std::string &mangled ) {
 
 // CALLSTACK
 
-		callstack::callstack( bool autosave ) {
-			if( autosave ) save();
-		}
+#if HEAL_UNWINDER == 1 && ( $on($linux) || $on($apple) ) && ( defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) )
+#   define HEAL_FRAME_POINTERS 1
+#endif
+#if HEAL_UNWINDER == 2 && $on($linux) && defined(__x86_64__)
+#   define HEAL_CFI 1
+#endif
 
-		size_t callstack::space() const {
-			return sizeof(frames) + sizeof(void *) * frames.size();
+#if HEAL_FRAME_POINTERS || HEAL_CFI
+#   include <pthread.h>
+
+		// limits of the stack of calling thread, queried once per thread
+		static bool stack_limits( const char *&lo, const char *&hi ) {
+			static $tls(const char *) low = 0;
+			static $tls(const char *) high = 0;
+			if( !high ) {
+				$linux({
+					pthread_attr_t attr;
+					if( pthread_getattr_np( pthread_self(), &attr ) == 0 ) {
+						void *addr = 0;
+						size_t size = 0;
+						if( pthread_attr_getstack( &attr, &addr, &size ) == 0 ) {
+							low = (const char *)addr;
+							high = low + size;
+						}
+						pthread_attr_destroy( &attr );
+					}
+				})
+				$apple({
+					high = (const char *)pthread_get_stackaddr_np( pthread_self() );
+					low = high - pthread_get_stacksize_np( pthread_self() );
+				})
+			}
+			lo = low, hi = high;
+			return high != 0;
 		}
+#endif
 
-		void callstack::save( unsigned frames_to_skip ) {
+#if HEAL_FRAME_POINTERS
 
-			if( frames_to_skip > max_frames )
-				return;
+		// follows the chain of saved frame pointers (code must be built with -fno-omit-frame-pointer).
+		// every frame has to be aligned, inside the thread stack and above the previous one, else the walk stops.
+		// returns ~0u if stack limits are unknown. never inlined, so the first frame is the caller (like backtrace()).
+		static __attribute__((noinline)) unsigned walk_frame_pointers( void **out, unsigned max_frames, unsigned skip ) {
+			const char *lo, *hi;
+			if( !stack_limits( lo, hi ) )
+				return ~0u;
 
-			frames.clear();
-			frames.resize( max_frames, (void *)0 );
-			void **out_frames = &frames[0]; // .data();
+			void **fp = (void **)__builtin_frame_address( 0 );
+			unsigned n = 0;
+			while( n < max_frames ) {
+				if( (const char *)fp < lo || (const char *)( fp + 2 ) > hi || ( uintptr_t( fp ) & ( sizeof(void *) - 1 ) ) )
+					break;
+				void *ret = fp[1];
+				if( !ret )
+					break;
+				if( skip ) --skip; else out[ n++ ] = ret;
+				void **next = (void **)fp[0];
+				if( next <= fp )
+					break;
+				fp = next;
+			}
+			return n;
+		}
+#endif
 
-			$windows({
-				unsigned short capturedFrames = 0;
+#if HEAL_CFI
+#   include <link.h>
 
-				// RtlCaptureStackBackTrace is only available on Windows XP or newer versions of Windows
-				typedef WORD(NTAPI FuncRtlCaptureStackBackTrace)(DWORD, DWORD, PVOID *, PDWORD);
+		// DWARF CFI unwinder for x86-64, driven by the .eh_frame_hdr of every loaded module.
+		// - modules are found with dl_iterate_phdr() and their search tables are kept, so .eh_frame_hdr is parsed once.
+		// - decoded rows (how to find CFA, return address and rbp) are cached per thread and per return address,
+		//   so hot call sites cost a cache lookup per frame.
+		// - no heap is used at all: module table is static, row caches live in TLS, everything else is on the stack.
+		namespace cfi {
 
-				static struct raii
-				{
-					raii() : module(0), ptrRtlCaptureStackBackTrace(0)
-					{
-						module = LoadLibraryA("kernel32.dll");
-						if( !module )
-							fail( "<heal/heal.cpp> says: error! cant load kernel32.dll" );
+			enum { DW_EH_PE_omit = 0xff, DW_EH_PE_indirect = 0x80, RBP = 6, RSP = 7, RA = 16, max_modules = 512, max_states = 16 };
 
-						ptrRtlCaptureStackBackTrace = (FuncRtlCaptureStackBackTrace *)GetProcAddress(module, "RtlCaptureStackBackTrace");
-						if( !ptrRtlCaptureStackBackTrace )
-							fail( "<heal/heal.cpp> says: error! cant find RtlCaptureStackBackTrace() process address" );
-					}
-					~raii() { if(module) FreeLibrary(module); }
+			struct module {
+				uintptr_t lo, hi;           // address range of its PT_LOAD segments
+				const uint8_t *hdr;         // .eh_frame_hdr
+				const uint8_t *table;       // sorted (initial location, fde) pairs, as sdata4 relative to hdr
+				size_t count;
+			};
 
-					HMODULE module;
-					FuncRtlCaptureStackBackTrace *ptrRtlCaptureStackBackTrace;
-				} module;
+			// modules only grow; a module may be unloaded, but its entry is never consulted for addresses that are not on the stack
+			static module modules[ max_modules ];
+			static size_t num_modules = 0;
+			static std::mutex modules_mutex;
+
+			// unwinding rule of a return address. cfa_reg == 0 marks addresses that cannot be unwound.
+			struct row {
+				uintptr_t pc;
+				int32_t cfa_off;
+				int16_t ra_off, rbp_off;
+				uint8_t cfa_reg, rbp_saved;
+			};
 
-				if( module.ptrRtlCaptureStackBackTrace )
-					capturedFrames = module.ptrRtlCaptureStackBackTrace(frames_to_skip+1, max_frames, out_frames, (DWORD *) 0);
+			static $tls(row) rows[ 512 ];
 
-				frames.resize( capturedFrames );
-				std::vector<void *>(frames).swap(frames);
-				return;
-			})
-			$gnuc({
-				// Ensure the output is cleared
-				std::memset(out_frames, 0, (sizeof(void *)) * max_frames);
+			template<typename T>
+			static T read( const uint8_t *&p ) {
+				T t;
+				std::memcpy( &t, p, sizeof(T) );
+				p += sizeof(T);
+				return t;
+			}
 
-				frames.resize( backtrace(out_frames, max_frames) );
-				std::vector<void *>(frames).swap(frames);
-				return;
-			})
-		}
+			static uint64_t uleb( const uint8_t *&p ) {
+				uint64_t v = 0;
+				for( unsigned shift = 0;; shift += 7 ) {
+					uint8_t b = *p++;
+					if( shift < 64 ) v |= uint64_t( b & 0x7f ) << shift;
+					if( !( b & 0x80 ) ) return v;
+				}
+			}
 
-		std::vector<std::string> callstack::unwind( unsigned from, unsigned to ) const
-		{
-			if( to == ~0 )
-				to = this->frames.size();
+			static int64_t sleb( const uint8_t *&p ) {
+				int64_t v = 0;
+				unsigned shift = 0;
+				uint8_t b;
+				do {
+					b = *p++;
+					if( shift < 64 ) v |= int64_t( b & 0x7f ) << shift;
+					shift += 7;
+				} while( b & 0x80 );
+				if( shift < 64 && ( b & 0x40 ) ) v |= -( int64_t(1) << shift );
+				return v;
+			}
 
-			if( from > to || from > this->frames.size() || to > this->frames.size() )
-				return std::vector<std::string>();
+			// reads a pointer in given DW_EH_PE encoding. only absolute, pc-relative and data-relative pointers are used by .eh_frame
+			static bool pointer( const uint8_t *&p, uint8_t enc, uintptr_t datarel, uintptr_t &out ) {
+				if( enc == DW_EH_PE_omit ) {
+					out = 0;
+					return true;
+				}
+				uintptr_t base;
+				switch( enc & 0x70 ) {
+					default: return false;
+					case 0x00: base = 0; break;
+					case 0x10: base = uintptr_t( p ); break;
+					case 0x30: base = datarel; break;
+				}
+				uintptr_t v;
+				switch( enc & 0x0f ) {
+					default: return false;
+					case 0x00: v = read<uintptr_t>( p ); break;
+					case 0x01: v = uintptr_t( uleb( p ) ); break;
+					case 0x02: v = read<uint16_t>( p ); break;
+					case 0x03: v = read<uint32_t>( p ); break;
+					case 0x04: v = uintptr_t( read<uint64_t>( p ) ); break;
+					case 0x09: v = uintptr_t( sleb( p ) ); break;
+					case 0x0a: v = uintptr_t( intptr_t( read<int16_t>( p ) ) ); break;
+					case 0x0b: v = uintptr_t( intptr_t( read<int32_t>( p ) ) ); break;
+					case 0x0c: v = uintptr_t( read<int64_t>( p ) ); break;
+				}
+				if( !v ) {
+					out = 0;
+					return true;
+				}
+				v += base;
+				if( enc & DW_EH_PE_indirect ) {
+					std::memcpy( &v, (const void *)v, sizeof(v) );
+				}
+				out = v;
+				return true;
+			}
 
-			const size_t num_frames = to - from;
-			std::vector<std::string> backtraces( num_frames );
+			static int add_module( struct dl_phdr_info *info, size_t, void * ) {
+				if( num_modules == max_modules ) {
+					return 1;
+				}
+				uintptr_t lo = ~uintptr_t(0), hi = 0;
+				const uint8_t *hdr = 0;
+				for( int i = 0; i < info->dlpi_phnum; ++i ) {
+					const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+					if( ph.p_type == PT_LOAD ) {
+						lo = std::min( lo, uintptr_t( info->dlpi_addr + ph.p_vaddr ) );
+						hi = std::max( hi, uintptr_t( info->dlpi_addr + ph.p_vaddr + ph.p_memsz ) );
+					}
+					if( ph.p_type == PT_GNU_EH_FRAME ) {
+						hdr = (const uint8_t *)( info->dlpi_addr + ph.p_vaddr );
+					}
+				}
+				// version 1, with a binary search table of sdata4 datarel pairs (what linkers emit)
+				if( !hdr || hdr[0] != 1 || hdr[3] != 0x3b ) {
+					return 0;
+				}
+				for( size_t i = 0; i < num_modules; ++i ) {
+					if( modules[i].hdr == hdr ) return 0;
+				}
+				const uint8_t *p = hdr + 4;
+				uintptr_t eh_frame, count;
+				if( !pointer( p, hdr[1], uintptr_t( hdr ), eh_frame ) || !pointer( p, hdr[2], uintptr_t( hdr ), count ) ) {
+					return 0;
+				}
+				module &m = modules[ num_modules++ ];
+				m.lo = lo;
+				m.hi = hi;
+				m.hdr = hdr;
+				m.table = p;
+				m.count = count;
+				return 0;
+			}
 
-			void * const * frames = &this->frames[ from ];
-			const std::string invalid = "????";
+			static const module *find_module( uintptr_t pc ) {
+				std::lock_guard<std::mutex> lock( modules_mutex );
+				for( int pass = 0; pass < 2; ++pass ) {
+					for( size_t i = 0; i < num_modules; ++i ) {
+						if( pc >= modules[i].lo && pc < modules[i].hi ) return &modules[i];
+					}
+					// new module (dlopen'd) or first use: scan again
+					if( !pass ) dl_iterate_phdr( add_module, 0 );
+				}
+				return 0;
+			}
 
-			$windows({
-				SymSetOptions(SYMOPT_UNDNAME);
+			struct rule {
+				uint8_t saved;   // 0: same value, 1: saved at cfa + off, 2: unsupported
+				int64_t off;
+			};
 
-				$no(
-					// polite version. this is how things should be done.
-					HANDLE process = GetCurrentProcess();
-					if( SymInitialize( process, NULL, TRUE ) )
-				)
-				$yes(
-					// this is what we have to do because other memory managers are not polite enough. fuck them off
-					static HANDLE process = GetCurrentProcess();
-					static int init = SymInitialize( process, NULL, TRUE );
-					if( !init )
-						fail( "<heal/heal.cpp> says: cannot initialize Dbghelp.lib" );
-				)
-				{
-					enum { MAXSYMBOLNAME = 512 - sizeof(IMAGEHLP_SYMBOL64) };
-					char symbol64_buf     [ 512 ];
-					char symbol64_bufblank[ 512 ] = {0};
-					IMAGEHLP_SYMBOL64 *symbol64       = reinterpret_cast<IMAGEHLP_SYMBOL64*>(symbol64_buf);
-					IMAGEHLP_SYMBOL64 *symbol64_blank = reinterpret_cast<IMAGEHLP_SYMBOL64*>(symbol64_bufblank);
-					symbol64_blank->SizeOfStruct = sizeof(IMAGEHLP_SYMBOL64);
-					symbol64_blank->MaxNameLength = (MAXSYMBOLNAME-1) / 2; //wchar?
+			struct state {
+				uint8_t cfa_reg;  // 0xff: unsupported cfa
+				int64_t cfa_off;
+				rule ra, rbp;
 
-					IMAGEHLP_LINE64 line64, line64_blank = {0};
-					line64_blank.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+				rule &reg( uint64_t r ) {
+					static $tls(rule) other;
+					return r == RA ? ra : r == RBP ? rbp : other;
+				}
+			};
 
-					for( unsigned i = 0; i < num_frames; i++ ) {
-						*symbol64 = *symbol64_blank;
-						DWORD64 displacement64 = 0;
+			struct cie {
+				uint64_t code_align;
+				int64_t data_align;
+				uint64_t ra_reg;
+				uint8_t fde_enc;
+				bool z;
+				const uint8_t *begin, *end;   // initial instructions
+			};
 
-						if( SymGetSymFromAddr64( process, (DWORD64) frames[i], &displacement64, symbol64 ) ) {
-							line64 = line64_blank;
-							DWORD displacement = 0;
-							if( SymGetLineFromAddr64( process, (DWORD64) frames[i], &displacement, &line64 ) ) {
-								backtraces[i] = heal::sfstring( "\1 (\2:\3)", symbol64->Name, line64.FileName, line64.LineNumber );
-							} else {
-								backtraces[i] = symbol64->Name;
-							}
-						} else  backtraces[i] = invalid;
+			// runs a CFA program until its location passes pc. returns false on unknown or unsupported opcodes.
+			static bool run( const uint8_t *p, const uint8_t *end, const cie &c, uintptr_t loc, uintptr_t pc, state &st, const state &initial ) {
+				state stack[ max_states ];
+				unsigned depth = 0;
+				while( p < end && loc <= pc ) {
+					uint8_t op = *p++;
+					uint64_t reg;
+					switch( op & 0xc0 ) {
+						case 0x40: loc += ( op & 0x3f ) * c.code_align; continue;
+						case 0x80: reg = op & 0x3f; st.reg( reg ).saved = 1; st.reg( reg ).off = int64_t( uleb( p ) ) * c.data_align; continue;
+						case 0xc0: reg = op & 0x3f; st.reg( reg ) = const_cast<state &>( initial ).reg( reg ); continue;
+						default: break;
+					}
+					switch( op ) {
+						default:
+							return false;
+						case 0x00: // nop
+							break;
+						case 0x01: // set_loc
+							if( !pointer( p, c.fde_enc, 0, loc ) ) return false;
+							break;
+						case 0x02: loc += read<uint8_t>( p ) * c.code_align; break;
+						case 0x03: loc += read<uint16_t>( p ) * c.code_align; break;
+						case 0x04: loc += read<uint32_t>( p ) * c.code_align; break;
+						case 0x05: // offset_extended
+							reg = uleb( p );
+							st.reg( reg ).saved = 1;
+							st.reg( reg ).off = int64_t( uleb( p ) ) * c.data_align;
+							break;
+						case 0x06: // restore_extended
+							reg = uleb( p );
+							st.reg( reg ) = const_cast<state &>( initial ).reg( reg );
+							break;
+						case 0x07: // undefined
+						case 0x08: // same_value
+							reg = uleb( p );
+							st.reg( reg ).saved = 0;
+							break;
+						case 0x09: // register
+							reg = uleb( p );
+							uleb( p );
+							st.reg( reg ).saved = 2;
+							break;
+						case 0x0a: // remember_state
+							if( depth == max_states ) return false;
+							stack[ depth++ ] = st;
+							break;
+						case 0x0b: // restore_state
+							if( !depth ) return false;
+							st = stack[ --depth ];
+							break;
+						case 0x0c: // def_cfa
+							st.cfa_reg = uint8_t( uleb( p ) );
+							st.cfa_off = int64_t( uleb( p ) );
+							break;
+						case 0x0d: // def_cfa_register
+							st.cfa_reg = uint8_t( uleb( p ) );
+							break;
+						case 0x0e: // def_cfa_offset
+							st.cfa_off = int64_t( uleb( p ) );
+							break;
+						case 0x0f: // def_cfa_expression
+							p += uleb( p );
+							st.cfa_reg = 0xff;
+							break;
+						case 0x10: // expression
+						case 0x16: // val_expression
+							reg = uleb( p );
+							p += uleb( p );
+							st.reg( reg ).saved = 2;
+							break;
+						case 0x11: // offset_extended_sf
+							reg = uleb( p );
+							st.reg( reg ).saved = 1;
+							st.reg( reg ).off = sleb( p ) * c.data_align;
+							break;
+						case 0x12: // def_cfa_sf
+							st.cfa_reg = uint8_t( uleb( p ) );
+							st.cfa_off = sleb( p ) * c.data_align;
+							break;
+						case 0x13: // def_cfa_offset_sf
+							st.cfa_off = sleb( p ) * c.data_align;
+							break;
+						case 0x14: // val_offset
+							reg = uleb( p );
+							uleb( p );
+							st.reg( reg ).saved = 2;
+							break;
+						case 0x15: // val_offset_sf
+							reg = uleb( p );
+							sleb( p );
+							st.reg( reg ).saved = 2;
+							break;
+						case 0x2e: // GNU_args_size
+							uleb( p );
+							break;
+						case 0x2f: // GNU_negative_offset_extended
+							reg = uleb( p );
+							st.reg( reg ).saved = 1;
+							st.reg( reg ).off = -int64_t( uleb( p ) ) * c.data_align;
+							break;
 					}
-
-					$no(
-						// fuck the others. cleanup commented.
-						SymCleanup(process);
-					)
 				}
-				DWORD error = GetLastError();
-
-				return backtraces;
-			})
-			$gnuc({
-				char **strings = backtrace_symbols(frames, num_frames);
+				return true;
+			}
 
-				// Decode the strings
-				if( strings ) {
-					for( unsigned i = 0; i < num_frames; i++ ) {
-						backtraces[i] = ( strings[i] ? demangle(strings[i]) : invalid );
+			static bool parse_cie( const uint8_t *p, cie &c ) {
+				uint64_t length = read<uint32_t>( p );
+				if( length == 0xffffffff ) length = read<uint64_t>( p );
+				const uint8_t *end = p + length;
+				if( read<uint32_t>( p ) != 0 ) return false;
+				uint8_t version = *p++;
+				const char *aug = (const char *)p;
+				p += std::strlen( aug ) + 1;
+				c.code_align = uleb( p );
+				c.data_align = sleb( p );
+				c.ra_reg = version == 1 ? *p++ : uleb( p );
+				c.fde_enc = 0;
+				c.z = aug[0] == 'z';
+				if( c.z ) {
+					uint64_t size = uleb( p );
+					const uint8_t *data = p;
+					p += size;
+					for( const char *a = aug + 1; *a; ++a ) {
+						uintptr_t ignored;
+						switch( *a ) {
+							default: return false;
+							case 'R': c.fde_enc = *data++; break;
+							case 'L': data++; break;
+							case 'P': { uint8_t enc = *data++; if( !pointer( data, enc & ~DW_EH_PE_indirect, 0, ignored ) ) return false; } break;
+							case 'S': break;
+						}
 					}
-					free( strings );
+				} else if( aug[0] ) {
+					return false;
 				}
+				c.begin = p;
+				c.end = end;
+				return c.ra_reg == RA;
+			}
 
-				return backtraces;
-			})
+			// finds and decodes the rule that unwinds given return address
+			static row decode( uintptr_t ret ) {
+				row r = row();
+				r.pc = ret;
+				uintptr_t pc = ret - 1;   // the call instruction, which may be the last one of its function
+
+				const module *m = find_module( pc );
+				if( !m || !m->count ) return r;
+
+				// binary search of the last table entry whose initial location is <= pc
+				const int32_t *table = (const int32_t *)m->table;
+				size_t lo = 0, hi = m->count;
+				while( hi - lo > 1 ) {
+					size_t mid = ( lo + hi ) / 2;
+					if( uintptr_t( m->hdr ) + intptr_t( table[ mid * 2 ] ) <= pc ) lo = mid; else hi = mid;
+				}
+				const uint8_t *fde = m->hdr + table[ lo * 2 + 1 ], *p = fde;
+
+				uint64_t length = read<uint32_t>( p );
+				if( length == 0xffffffff ) return r;
+				const uint8_t *end = p + length, *cie_ptr = p;
+				cie_ptr -= read<uint32_t>( p );
+
+				cie c;
+				if( !parse_cie( cie_ptr, c ) ) return r;
+
+				uintptr_t begin, range;
+				if( !pointer( p, c.fde_enc, 0, begin ) || !pointer( p, c.fde_enc & 0x0f, 0, range ) ) return r;
+				if( pc < begin || pc >= begin + range ) return r;
+				if( c.z ) p += uleb( p );
+
+				state initial = state();
+				if( !run( c.begin, c.end, c, begin, ~uintptr_t(0), initial, initial ) ) return r;
+				state st = initial;
+				if( !run( p, end, c, begin, pc, st, initial ) ) return r;
+
+				if( ( st.cfa_reg != RSP && st.cfa_reg != RBP ) || st.ra.saved != 1 || st.rbp.saved == 2 ) return r;
+				r.cfa_reg = st.cfa_reg;
+				r.cfa_off = int32_t( st.cfa_off );
+				r.ra_off = int16_t( st.ra.off );
+				r.rbp_saved = st.rbp.saved;
+				r.rbp_off = int16_t( st.rbp.off );
+				return r;
+			}
 
-			return backtraces;
-		}
+			static const row &lookup( uintptr_t ret ) {
+				row &r = rows[ ( ret * 0x9E3779B97F4A7C15ULL ) >> ( 64 - 9 ) ];
+				if( r.pc != ret ) r = decode( ret );
+				return r;
+			}
 
-		std::vector<std::string> callstack::str( const char *format12, size_t skip_begin ) const {
-			callstack copy = *this;
-			std::vector<std::string> stacktrace = copy.unwind( skip_begin );
+			// returns ~0u if stack limits are unknown. never inlined, so the first frame is the caller (like backtrace()).
+			static __attribute__((noinline)) unsigned walk( void **out, unsigned max_frames, unsigned skip ) {
+				const char *lo, *hi;
+				if( !stack_limits( lo, hi ) )
+					return ~0u;
 
-			for( size_t i = 0, end = stacktrace.size(); i < end; i++ )
-				stacktrace[i] = heal::sfstring( format12, i + 1, stacktrace[i] );
+				// registers of the caller, as they are right after this function returns
+				// note: __builtin_frame_address(0) forces a frame pointer in this function
+				uintptr_t *fp = (uintptr_t *)__builtin_frame_address( 0 );
+				uintptr_t pc = fp[1], rsp = uintptr_t( fp + 2 ), rbp = fp[0];
 
-			return stacktrace;
-		}
+				unsigned n = 0;
+				while( n < max_frames && pc ) {
+					if( skip ) --skip; else out[ n++ ] = (void *)pc;
 
-		std::string callstack::flat( const char *format12, size_t skip_begin ) const {
-			std::vector<std::string> vec = str( format12, skip_begin );
-			std::string str;
-			for( std::vector<std::string>::const_iterator it = vec.begin(), end = vec.end(); it != end; ++it ) {
-				str += *it;
+					const row &r = lookup( pc );
+					if( !r.cfa_reg )
+						break;
+					uintptr_t cfa = ( r.cfa_reg == RSP ? rsp : rbp ) + r.cfa_off;
+					if( cfa <= rsp || cfa + r.ra_off < uintptr_t( lo ) || cfa > uintptr_t( hi ) || ( cfa & 7 ) )
+						break;
+					if( r.rbp_saved ) {
+						if( cfa + r.rbp_off < uintptr_t( lo ) ) break;
+						rbp = *(const uintptr_t *)( cfa + r.rbp_off );
+					}
+					pc = *(const uintptr_t *)( cfa + r.ra_off );
+					rsp = cfa;
+				}
+				return n;
 			}
-			return str;
 		}
+#endif
 
-std::vector<std::string> stacktrace( const char *format12, size_t skip_initial ) {
-	return callstack(true).str( format12, skip_initial );
-}
+#if $on($linux)
+#   define HEAL_SYMBOLIZER 1
+
+		// in-process symbolizer for ELF modules.
+		// - modules are found in /proc/self/maps, and every module file is mapped once, read-only.
+		// - function names come from .symtab/.dynsym, sorted by address and binary searched.
+		// - file:line comes from .debug_line (DWARF 2-5). its sequences are indexed by address range in one pass,
+		//   and only the sequences that frames fall in are decoded later, so big binaries do not cost their whole
+		//   line table in memory.
+		// - frames are resolved in parallel, split by module and sequence (see HEAL_SYMBOLIZER_THREADS).
+		// compressed debug sections and separate debug files are not read; such frames get function names only.
+		// every module remembers its resolved addresses. with a HEAL_SYMBOL_CACHE directory, modules with a build-id
+		// also keep them on disk, so later runs of the same build resolve known frames without touching debug info.
+		namespace elf {
+
+			struct symbol {
+				uintptr_t addr, size;
+				const char *name;
+				bool operator<( const symbol &other ) const {
+					return addr < other.addr;
+				}
+			};
 
-std::string stackstring( const char *format12, size_t skip_initial ) {
-	std::string out;
-	std::vector<std::string> stack = stacktrace( format12, skip_initial );
-	for( std::vector<std::string>::const_iterator it = stack.begin(), end = stack.end(); it != end; ++it ) {
-		out += *it;
-	}
-	return out;
-}
+			// rows of a line program. line 0 marks the end of a sequence, and sorts before any row starting at the same address
+			struct line {
+				uintptr_t addr;
+				unsigned file, number;
+				bool operator<( const line &other ) const {
+					return addr != other.addr ? addr < other.addr : !number && other.number;
+				}
+			};
 
-// DIE
+			// a sequence of a line program covers [lo, hi) with no gaps
+			struct sequence {
+				uintptr_t lo, hi;
+				size_t unit;    // offset of its unit in .debug_line
+				size_t start;   // offset of its first opcode in .debug_line
+				bool operator<( const sequence &other ) const {
+					return lo < other.lo;
+				}
+			};
 
-void die( const std::string &reason, int errorcode )
-{
-	if( !reason.empty() ) {
-		fail( reason );
-	}
+			struct unit {
+				std::vector<std::string> files;
+				std::vector<line> lines;
+			};
 
-	$windows(
-	FatalExit( errorcode );
-	)
+			struct image {
+				const uint8_t *data;
+				size_t size;
+				std::vector<ElfW(Phdr)> loads;
+				std::vector<symbol> symbols;
+				const uint8_t *debug_line, *debug_str, *debug_line_str;
+				size_t debug_line_size, debug_str_size, debug_line_str_size;
+				std::vector<sequence> sequences;
+				std::string build_id;                   // hex, empty if none
+				typedef std::map<uintptr_t, std::string, std::less<uintptr_t>, HEAL_ALLOCATOR<std::pair<const uintptr_t, std::string> > > symbol_map;
+				symbol_map known;                       // resolved symbols by module address
+				std::string cache_path;                 // on-disk cache, if enabled
+				int cache;                              // its descriptor once appending, or -1
+			};
 
-	// fallback
-	std::exit( errorcode );
-}
+			// on-disk cache: <HEAL_SYMBOL_CACHE>/<build-id>.symbols, a sequence of records (header + text).
+			// writers append whole records with a single write() under an exclusive flock(), so concurrent processes
+			// never interleave; readers stop at the first record that fails its check (a writer died mid-write).
+			struct record {
+				uint32_t length, check;
+				uint64_t addr;
+			};
 
-void die( int errorcode, const std::string &reason )
-{
-	die( reason, errorcode );
-}
+			static uint32_t checksum( uint64_t addr, const char *text, size_t length ) {
+				uint32_t h = 2166136261u;
+				for( unsigned i = 0; i < 8; ++i ) h = ( h ^ uint8_t( addr >> ( i * 8 ) ) ) * 16777619u;
+				for( size_t i = 0; i < length; ++i ) h = ( h ^ uint8_t( text[i] ) ) * 16777619u;
+				return h;
+			}
 
-// HEXDUMP
-// @todo: maxwidth != 80 doesnt work
+			static void open_cache( image &img ) {
+				std::string dir( HEAL_SYMBOL_CACHE );
+				if( dir.empty() || img.build_id.empty() ) {
+					return;
+				}
+				img.cache_path = dir + "/" + img.build_id + ".symbols";
+				int fd = open( img.cache_path.c_str(), O_RDONLY | O_CLOEXEC );
+				if( fd < 0 ) {
+					return;
+				}
+				struct stat st;
+				flock( fd, LOCK_SH );
+				if( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+					void *data = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+					if( data != MAP_FAILED ) {
+						const char *p = (const char *)data, *end = p + st.st_size;
+						record r;
+						while( size_t( end - p ) >= sizeof(r) ) {
+							std::memcpy( &r, p, sizeof(r) );
+							if( r.length > size_t( end - p ) - sizeof(r) || r.check != checksum( r.addr, p + sizeof(r), r.length ) ) break;
+							img.known[ uintptr_t( r.addr ) ].assign( p + sizeof(r), r.length );
+							p += sizeof(r) + r.length;
+						}
+						munmap( data, st.st_size );
+					}
+				}
+				flock( fd, LOCK_UN );
+				close( fd );
+			}
 
-std::string hexdump( const void *data, size_t num_bytes, const void *self )
-{
-#   ifdef _MSC_VER
-#       pragma warning( push )
-#       pragma warning( disable : 4996 )
-#       define $vsnprintf _vsnprintf
-#   else
-#       define $vsnprintf  vsnprintf
-#   endif
+			static void append_cache( image &img, uintptr_t addr, const std::string &text ) {
+				if( img.cache < 0 && !img.cache_path.empty() ) {
+					mkdir( HEAL_SYMBOL_CACHE, 0755 );
+					img.cache = open( img.cache_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+					if( img.cache < 0 ) img.cache_path.clear();
+				}
+				if( img.cache < 0 ) {
+					return;
+				}
+				record r = { uint32_t( text.size() ), checksum( addr, text.data(), text.size() ), addr };
+				std::string buf( (const char *)&r, sizeof(r) );
+				buf += text;
+				flock( img.cache, LOCK_EX );
+				ssize_t written = write( img.cache, buf.data(), buf.size() );
+				flock( img.cache, LOCK_UN );
+				(void)written;
+			}
 
-	struct local {
-		static std::string format( const char *fmt, ... )
-		{
-			int len;
-			std::string self;
+			struct mapping {
+				uintptr_t lo, hi, offset;
+				image *img;
+			};
 
-			using namespace std;
+			// symbolization may run before static constructors (tracey starts on the very first allocation),
+			// so the state is built on first use and never destroyed.
+			struct state {
+				std::vector<mapping> mappings;
+				typedef std::map<std::string, image *, std::less<std::string>, HEAL_ALLOCATOR<std::pair<const std::string, image *> > > image_map;
+				image_map images;
+				std::mutex mutex;
+			};
 
-			// Calculate the final length of the formatted string
-			{
-				va_list args;
-				va_start( args, fmt );
-				len = $vsnprintf( 0, 0, fmt, args );
-				va_end( args );
+			static state *&instance() {
+				static state *s = new state();
+				return s;
+			}
+			static state &self() {
+				return *instance();
 			}
 
-			// Allocate a buffer (including room for null termination
-			char* target_string = new char[++len];
+			// set in forked children, which must not start threads of their own
+			static bool forked = false;
 
-			// Generate the formatted string
-			{
-				va_list args;
-				va_start( args, fmt );
-				$vsnprintf( target_string, len, fmt, args );
-				va_end( args );
+			template<typename T>
+			static T read( const uint8_t *&p ) {
+				T t;
+				std::memcpy( &t, p, sizeof(T) );
+				p += sizeof(T);
+				return t;
 			}
 
-			// Assign the formatted string
-			self.assign( target_string );
+			static uint64_t uleb( const uint8_t *&p, const uint8_t *end ) {
+				uint64_t v = 0;
+				for( unsigned shift = 0; p < end; shift += 7 ) {
+					uint8_t b = *p++;
+					if( shift < 64 ) v |= uint64_t( b & 0x7f ) << shift;
+					if( !( b & 0x80 ) ) break;
+				}
+				return v;
+			}
 
-			// Clean up
-			delete [] target_string;
+			static int64_t sleb( const uint8_t *&p, const uint8_t *end ) {
+				int64_t v = 0;
+				unsigned shift = 0;
+				uint8_t b = 0;
+				while( p < end ) {
+					b = *p++;
+					if( shift < 64 ) v |= int64_t( b & 0x7f ) << shift;
+					shift += 7;
+					if( !( b & 0x80 ) ) break;
+				}
+				if( shift < 64 && ( b & 0x40 ) ) v |= -( int64_t(1) << shift );
+				return v;
+			}
 
-			return self;
-		}
-	};
+			static const char *cstr( const uint8_t *&p, const uint8_t *end ) {
+				const char *s = (const char *)p;
+				while( p < end && *p ) ++p;
+				if( p == end ) return 0;
+				++p;
+				return s;
+			}
 
-	unsigned maxwidth = 80;
-	unsigned width = 16; //column width
-	unsigned width_offset_block = (8 + 1);
-	unsigned width_chars_block  = (width * 3 + 1) + sizeof("asc");
-	unsigned width_hex_block    = (width * 3 + 1) + sizeof("hex");
-	unsigned width_padding = (std::max)( 0, int( maxwidth - ( width_offset_block + width_chars_block + width_hex_block ) ) );
-	unsigned blocks = width_padding / ( width_chars_block + width_hex_block ) ;
+			static const char *strp( const uint8_t *table, size_t size, uint64_t offset ) {
+				return table && offset < size ? (const char *)( table + offset ) : 0;
+			}
 
-	unsigned dumpsize = ( num_bytes < width * 16 ? num_bytes : width * 16 ); //16 lines max
+			// reads the file names of a DWARF 5 header (directories or files). only the path and directory index are kept.
+			static bool entries( const image &img, const uint8_t *&p, const uint8_t *end, unsigned offset_size,
+				std::vector<std::string> &paths, std::vector<uint64_t> &dirs ) {
+				uint8_t num_formats = read<uint8_t>( p );
+				uint64_t formats[ 32 ][ 2 ];
+				if( num_formats > 32 ) return false;
+				for( unsigned f = 0; f < num_formats; ++f ) {
+					formats[f][0] = uleb( p, end );
+					formats[f][1] = uleb( p, end );
+				}
+				for( uint64_t n = uleb( p, end ); n-- > 0 && p < end; ) {
+					const char *path = "";
+					uint64_t dir = 0;
+					for( unsigned f = 0; f < num_formats; ++f ) {
+						uint64_t value = 0;
+						const char *text = 0;
+						switch( formats[f][1] ) {
+							default: return false;
+							case 0x08 /*string*/:    text = cstr( p, end ); break;
+							case 0x0e /*strp*/:      value = offset_size == 8 ? read<uint64_t>( p ) : read<uint32_t>( p ); text = strp( img.debug_str, img.debug_str_size, value ); break;
+							case 0x1f /*line_strp*/: value = offset_size == 8 ? read<uint64_t>( p ) : read<uint32_t>( p ); text = strp( img.debug_line_str, img.debug_line_str_size, value ); break;
+							case 0x0b /*data1*/:     value = read<uint8_t>( p ); break;
+							case 0x05 /*data2*/:     value = read<uint16_t>( p ); break;
+							case 0x06 /*data4*/:     value = read<uint32_t>( p ); break;
+							case 0x07 /*data8*/:     value = read<uint64_t>( p ); break;
+							case 0x0f /*udata*/:     value = uleb( p, end ); break;
+							case 0x1e /*data16*/:    p += 16; break;
+							case 0x09 /*block*/:     p += uleb( p, end ); break;
+						}
+						if( formats[f][0] == 1 /*DW_LNCT_path*/ && text ) path = text;
+						if( formats[f][0] == 2 /*DW_LNCT_directory_index*/ ) dir = value;
+					}
+					paths.push_back( path );
+					dirs.push_back( dir );
+				}
+				return p <= end;
+			}
 
-	std::string result;
+			// parses the line program of the unit at given offset. with an output unit, its files (unless known) and rows
+			// are decoded, either all of them or the ones of the sequence at given start; else only the address ranges of
+			// its sequences are collected. returns the offset of next unit, or 0 when done.
+			static size_t program( image &img, size_t offset, unit *out, std::vector<sequence> *ranges, size_t start = 0 ) {
+				const uint8_t *p = img.debug_line + offset, *section_end = img.debug_line + img.debug_line_size;
+				if( section_end - p < 4 ) return 0;
+				unsigned offset_size = 4;
+				uint64_t length = read<uint32_t>( p );
+				if( length == 0xffffffff ) {
+					if( section_end - p < 8 ) return 0;
+					length = read<uint64_t>( p );
+					offset_size = 8;
+				}
+				if( length > uint64_t( section_end - p ) ) return 0;
+				const uint8_t *end = p + length;
+				size_t next = size_t( end - img.debug_line );
+
+				uint16_t version = read<uint16_t>( p );
+				if( version < 2 || version > 5 ) return next;
+				if( version >= 5 ) {
+					p += 2; // address and segment selector sizes
+				}
+				uint64_t header_length = offset_size == 8 ? read<uint64_t>( p ) : read<uint32_t>( p );
+				const uint8_t *code = p + header_length;
+				if( code > end ) return next;
+				uint8_t min_inst = read<uint8_t>( p );
+				if( version >= 4 ) p++; // max ops per instruction
+				bool default_is_stmt = read<uint8_t>( p ) != 0;
+				int8_t line_base = read<int8_t>( p );
+				uint8_t line_range = read<uint8_t>( p );
+				uint8_t opcode_base = read<uint8_t>( p );
+				const uint8_t *opcode_lengths = p;
+				p += opcode_base ? opcode_base - 1 : 0;
+				if( !line_range || p > code ) return next;
+
+				if( out && out->files.empty() ) {
+					std::vector<std::string> dirs, names;
+					std::vector<uint64_t> dir_of;
+					if( version >= 5 ) {
+						std::vector<uint64_t> unused;
+						if( !entries( img, p, code, offset_size, dirs, unused ) || !entries( img, p, code, offset_size, names, dir_of ) ) return next;
+					} else {
+						dirs.push_back( "" );
+						while( p < code && *p ) dirs.push_back( cstr( p, code ) );
+						p++;
+						names.push_back( "" );
+						dir_of.push_back( 0 );
+						while( p < code && *p ) {
+							const char *name = cstr( p, code );
+							if( !name ) return next;
+							names.push_back( name );
+							dir_of.push_back( uleb( p, code ) );
+							uleb( p, code );
+							uleb( p, code );
+						}
+					}
+					for( size_t i = 0; i < names.size(); ++i ) {
+						const std::string &dir = dir_of[i] < dirs.size() ? dirs[ dir_of[i] ] : std::string();
+						out->files.push_back( names[i].empty() || names[i][0] == '/' || dir.empty() ? names[i] : dir + "/" + names[i] );
+					}
+				}
 
-	result += local::format( "%-*s %-.*s [ptr=%p sz=%d]\n", width_offset_block - 1, "offset", width_chars_block - 1, "00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F", self ? self : data, num_bytes );
+				// state machine
+				p = code;
+				if( start ) {
+					if( start < size_t( code - img.debug_line ) || start >= next ) return next;
+					p = img.debug_line + start;
+				}
+				const uint8_t *begin = p;
+				uintptr_t addr = 0, lo = 0;
+				unsigned file = 1, number = 1;
+				bool is_stmt = default_is_stmt, open = false;
+				while( p < end ) {
+					uint8_t op = read<uint8_t>( p );
+					bool emit = false, last = false;
+					if( op >= opcode_base ) {
+						unsigned adjusted = op - opcode_base;
+						addr += ( adjusted / line_range ) * min_inst;
+						number += line_base + int( adjusted % line_range );
+						emit = true;
+					} else if( op == 0 ) {
+						uint64_t len = uleb( p, end );
+						const uint8_t *next_op = p + len;
+						if( !len || next_op > end ) break;
+						uint8_t sub = read<uint8_t>( p );
+						if( sub == 1 /*end_sequence*/ ) {
+							emit = last = true;
+						} else if( sub == 2 /*set_address*/ ) {
+							addr = len - 1 == 8 ? uintptr_t( read<uint64_t>( p ) ) : len - 1 == 4 ? uintptr_t( read<uint32_t>( p ) ) : addr;
+						}
+						p = next_op;
+					} else switch( op ) {
+						case 1 /*copy*/:              emit = true; break;
+						case 2 /*advance_pc*/:        addr += uleb( p, end ) * min_inst; break;
+						case 3 /*advance_line*/:      number += int( sleb( p, end ) ); break;
+						case 4 /*set_file*/:          file = unsigned( uleb( p, end ) ); break;
+						case 6 /*negate_stmt*/:       is_stmt = !is_stmt; break;
+						case 8 /*const_add_pc*/:      addr += ( ( 255 - opcode_base ) / line_range ) * min_inst; break;
+						case 9 /*fixed_advance_pc*/:  addr += read<uint16_t>( p ); break;
+						default:
+							for( unsigned i = 0; i < opcode_lengths[ op - 1 ]; ++i ) uleb( p, end );
+					}
+					if( !emit ) continue;
+					if( !open ) {
+						lo = addr;
+						open = true;
+					}
+					if( out ) {
+						line l = { addr, file, last ? 0 : number };
+						out->lines.push_back( l );
+					}
+					if( last ) {
+						if( ranges && addr > lo ) {
+							sequence s = { lo, addr, offset, size_t( begin - img.debug_line ) };
+							ranges->push_back( s );
+						}
+						if( start ) break;
+						addr = 0, file = 1, number = 1, is_stmt = default_is_stmt, open = false;
+						begin = p;
+					}
+				}
+				return next;
+			}
 
-	if( !num_bytes )
-		return result;
+			static image *load( const std::string &path ) {
+				state::image_map::iterator found = self().images.find( path );
+				if( found != self().images.end() ) {
+					return found->second;
+				}
+				image *img = 0;
+				int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+				struct stat st;
+				if( fd >= 0 && fstat( fd, &st ) == 0 && size_t( st.st_size ) >= sizeof(ElfW(Ehdr)) ) {
+					void *data = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+					if( data != MAP_FAILED ) {
+						img = new image();
+						img->cache = -1;
+						img->data = (const uint8_t *)data;
+						img->size = st.st_size;
+					}
+				}
+				if( fd >= 0 ) close( fd );
+				self().images[ path ] = img;
+				if( !img ) {
+					return 0;
+				}
 
-	blocks++;
+				const uint8_t *base = img->data;
+				const ElfW(Ehdr) &eh = *(const ElfW(Ehdr) *)base;
+				if( std::memcmp( eh.e_ident, ELFMAG, SELFMAG ) || eh.e_ident[ EI_CLASS ] != ( sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32 ) ||
+					eh.e_phoff + eh.e_phnum * sizeof(ElfW(Phdr)) > img->size || eh.e_shoff + eh.e_shnum * sizeof(ElfW(Shdr)) > img->size ) {
+					return img;
+				}
+				const ElfW(Phdr) *ph = (const ElfW(Phdr) *)( base + eh.e_phoff );
+				for( unsigned i = 0; i < eh.e_phnum; ++i ) {
+					if( ph[i].p_type == PT_LOAD ) img->loads.push_back( ph[i] );
+					if( ph[i].p_type != PT_NOTE || ph[i].p_offset + ph[i].p_filesz > img->size ) continue;
+					// notes are aligned to 4 bytes; the gnu build-id is the one named "GNU" of type NT_GNU_BUILD_ID
+					for( const uint8_t *p = base + ph[i].p_offset, *end = p + ph[i].p_filesz; size_t( end - p ) >= sizeof(ElfW(Nhdr)); ) {
+						ElfW(Nhdr) note;
+						std::memcpy( &note, p, sizeof(note) );
+						const uint8_t *name = p + sizeof(note), *desc = name + ( ( note.n_namesz + 3 ) & ~3u );
+						p = desc + ( ( note.n_descsz + 3 ) & ~3u );
+						if( p > end ) break;
+						if( note.n_type == NT_GNU_BUILD_ID && note.n_namesz == 4 && !std::memcmp( name, "GNU", 4 ) ) {
+							static const char hex[] = "0123456789abcdef";
+							for( unsigned j = 0; j < note.n_descsz; ++j ) {
+								img->build_id += hex[ desc[j] >> 4 ];
+								img->build_id += hex[ desc[j] & 15 ];
+							}
+						}
+					}
+				}
+				open_cache( *img );
+
+				const ElfW(Shdr) *sh = (const ElfW(Shdr) *)( base + eh.e_shoff );
+				const char *names = eh.e_shstrndx < eh.e_shnum && sh[ eh.e_shstrndx ].sh_offset < img->size ? (const char *)( base + sh[ eh.e_shstrndx ].sh_offset ) : 0;
+				img->debug_line = img->debug_str = img->debug_line_str = 0;
+				img->debug_line_size = img->debug_str_size = img->debug_line_str_size = 0;
+				for( unsigned i = 0; i < eh.e_shnum; ++i ) {
+					const ElfW(Shdr) &s = sh[i];
+					if( s.sh_type == SHT_NOBITS || s.sh_offset + s.sh_size > img->size ) continue;
+					if( ( s.sh_type == SHT_SYMTAB || s.sh_type == SHT_DYNSYM ) && s.sh_link < eh.e_shnum && s.sh_entsize == sizeof(ElfW(Sym)) ) {
+						const ElfW(Shdr) &strtab = sh[ s.sh_link ];
+						if( strtab.sh_offset + strtab.sh_size > img->size ) continue;
+						const ElfW(Sym) *sym = (const ElfW(Sym) *)( base + s.sh_offset );
+						for( size_t j = 0, n = s.sh_size / sizeof(ElfW(Sym)); j < n; ++j ) {
+							unsigned type = ELF32_ST_TYPE( sym[j].st_info );
+							if( ( type == STT_FUNC || type == STT_GNU_IFUNC ) && sym[j].st_value && sym[j].st_shndx != SHN_UNDEF && sym[j].st_name < strtab.sh_size ) {
+								symbol entry = { uintptr_t( sym[j].st_value ), uintptr_t( sym[j].st_size ), (const char *)( base + strtab.sh_offset + sym[j].st_name ) };
+								img->symbols.push_back( entry );
+							}
+						}
+					}
+					if( !names || ( s.sh_flags & SHF_COMPRESSED ) ) continue;
+					const char *name = names + s.sh_name;
+					/**/ if( !std::strcmp( name, ".debug_line" ) )     img->debug_line = base + s.sh_offset, img->debug_line_size = s.sh_size;
+					else if( !std::strcmp( name, ".debug_str" ) )      img->debug_str = base + s.sh_offset, img->debug_str_size = s.sh_size;
+					else if( !std::strcmp( name, ".debug_line_str" ) ) img->debug_line_str = base + s.sh_offset, img->debug_line_str_size = s.sh_size;
+				}
+				std::sort( img->symbols.begin(), img->symbols.end() );
 
-	const unsigned char *p = reinterpret_cast<const unsigned char *>( data );
-	size_t i = 0;
+				for( size_t offset = 0; img->debug_line && offset < img->debug_line_size; ) {
+					offset = program( *img, offset, 0, &img->sequences );
+					if( !offset ) break;
+				}
+				std::sort( img->sequences.begin(), img->sequences.end() );
+				return img;
+			}
 
-	while( i < dumpsize )
-	{
-		//offset block
-		result += local::format("%p ", (size_t)(p + i) ); //%08x, %08zx
+			static void scan_maps() {
+				std::vector<mapping> &mappings = self().mappings;
+				mappings.clear();
+				FILE *fp = fopen( "/proc/self/maps", "r" );
+				if( !fp ) {
+					return;
+				}
+				char buf[ 4096 ];
+				while( fgets( buf, sizeof(buf), fp ) ) {
+					unsigned long lo, hi, offset;
+					char perms[ 8 ];
+					int path_at = 0;
+					if( sscanf( buf, "%lx-%lx %7s %lx %*s %*s %n", &lo, &hi, perms, &offset, &path_at ) < 4 || !path_at || buf[ path_at ] != '/' || perms[2] != 'x' ) {
+						continue;
+					}
+					std::string path( buf + path_at );
+					while( !path.empty() && ( path[ path.size() - 1 ] == '\n' || path[ path.size() - 1 ] == ' ' ) ) path.resize( path.size() - 1 );
+					mapping m = { uintptr_t( lo ), uintptr_t( hi ), uintptr_t( offset ), load( path ) };
+					if( m.img ) mappings.push_back( m );
+				}
+				fclose( fp );
+			}
 
-		//chars blocks
-		for( unsigned b = 0; b < blocks; b++)
-		{
-			for( unsigned c = 0 ; c < width ; c++ )
-				result += local::format(" %c ", i + c >= dumpsize ? '.' : p[i + c] < 32 || p[i + c] >= 127 ? '.' : p[i + c]);
+			// address in the module file (link-time virtual address) of given runtime address
+			static image *find( uintptr_t pc, uintptr_t &vaddr ) {
+				const std::vector<mapping> &mappings = self().mappings;
+				for( int pass = 0; pass < 2; ++pass ) {
+					for( size_t i = 0; i < mappings.size(); ++i ) {
+						const mapping &m = mappings[i];
+						if( pc < m.lo || pc >= m.hi ) continue;
+						uintptr_t file_offset = pc - m.lo + m.offset;
+						for( size_t j = 0; j < m.img->loads.size(); ++j ) {
+							const ElfW(Phdr) &ph = m.img->loads[j];
+							if( file_offset >= ph.p_offset && file_offset < ph.p_offset + ph.p_filesz ) {
+								vaddr = file_offset - ph.p_offset + ph.p_vaddr;
+								return m.img;
+							}
+						}
+						return 0;
+					}
+					// new module (dlopen'd) or first use: scan again
+					if( !pass ) scan_maps();
+				}
+				return 0;
+			}
 
-			result += "asc\n";
-		}
+			// a frame to resolve: its module, function, and the line sequence around its call site (if any)
+			struct task {
+				image *img;
+				uintptr_t vaddr, pc;
+				const symbol *sym;
+				const sequence *seq;
+				size_t frame, slot; // index of its frame, and of its text
+				bool operator<( const task &other ) const {
+					if( img != other.img ) return img < other.img;
+					return ( seq ? seq->start : 0 ) < ( other.seq ? other.seq->start : 0 );
+				}
+			};
 
-		//offset block
-		result += local::format("%p ", (size_t)(p + i) ); //%08x, %08zx
+			static task plan( image *img, uintptr_t vaddr, size_t frame, size_t slot ) {
+				task t = { img, vaddr, vaddr, 0, 0, frame, slot };
+				symbol key = { vaddr, 0, 0 };
+				std::vector<symbol>::const_iterator it = std::upper_bound( img->symbols.begin(), img->symbols.end(), key );
+				if( it != img->symbols.begin() && ( !(it - 1)->size || vaddr < (it - 1)->addr + (it - 1)->size ) ) {
+					t.sym = &*(it - 1);
+				}
+				// frames are return addresses, so the call is the instruction before (unless that falls out of the function)
+				if( t.sym && vaddr > t.sym->addr ) t.pc = vaddr - 1;
+				sequence probe = { t.pc, 0, 0, 0 };
+				std::vector<sequence>::const_iterator seq = std::upper_bound( img->sequences.begin(), img->sequences.end(), probe );
+				if( seq != img->sequences.begin() && t.pc < (seq - 1)->hi ) {
+					t.seq = &*(seq - 1);
+				}
+				return t;
+			}
 
-		//hex blocks
-		for( unsigned b = 0; b < blocks; b++)
-		{
-			for( unsigned c = 0; c < width ; c++)
-				result += local::format( i + c < dumpsize ? "%02x " : "?? ", p[i + c]);
+			// resolves tasks of one module and sequence into "function (file:line)", as precise as the debug info allows.
+			// the files of the last unit are kept, since tasks come sorted and consecutive sequences often share it.
+			struct worker {
+				unit u;
+				size_t u_offset;
+				worker() : u_offset( 0 )
+				{}
+				void run( const task *t, const task *end, std::vector<std::string> &texts ) {
+					if( t->seq ) {
+						if( u_offset != t->seq->unit ) {
+							u.files.clear();
+							u_offset = t->seq->unit;
+						}
+						u.lines.clear();
+						program( *t->img, t->seq->unit, &u, 0, t->seq->start );
+					}
+					for( ; t != end; ++t ) {
+						std::string name;
+						if( t->sym ) {
+							int status = 0;
+							char *demangled = abi::__cxa_demangle( t->sym->name, 0, 0, &status );
+							name = status == 0 && demangled ? demangled : t->sym->name;
+							if( demangled ) free( demangled );
+						}
+						// last row at or before pc. an end of sequence there means pc falls in a gap
+						line probe = { t->pc, 0, ~0u };
+						std::vector<line>::const_iterator row = std::upper_bound( u.lines.begin(), u.lines.end(), probe );
+						if( t->seq && row != u.lines.begin() && (--row)->number && row->file < u.files.size() ) {
+							name = heal::sfstring( "\1 (\2:\3)", name.empty() ? "????" : name, u.files[ row->file ], row->number );
+						}
+						texts[ t->slot ] = name;
+					}
+				}
+			};
 
-			result += "hex\n";
-		}
+			// jobs are runs of tasks sharing module and sequence, so every piece of debug info is decoded by one worker
+			struct pool {
+				const std::vector<task> *tasks;
+				const std::vector<size_t> *jobs; // first task of every job, plus an end marker
+				std::vector<std::string> *texts;
+#if $on($cpp11)
+				std::atomic<size_t> next;
+#else
+				size_t next;
+#endif
+			};
 
-		//next line
-		//result += '\n';
-		i += width * blocks;
-	}
+			static void drain( pool *p ) {
+				worker w;
+				for( size_t j; ( j = p->next++ ) + 1 < p->jobs->size(); ) {
+					const task *first = &(*p->tasks)[0];
+					w.run( first + (*p->jobs)[j], first + (*p->jobs)[j + 1], *p->texts );
+				}
+			}
 
-	return result;
+			static void drain_thread( pool *p ) {
+				HEAL_THREAD_PROLOGUE();
+				drain( p );
+			}
 
-#   undef $vsnprintf
-#   ifdef _MSC_VER
-#       pragma warning( pop )
-#   endif
-}
+			// resolves given module addresses in one pass. frames without a module are left empty. locked by caller.
+			static void resolve( image *const *imgs, const uintptr_t *vaddrs, size_t num_frames, std::vector<std::string> &out ) {
+				enum { min_frames_per_thread = 64 };
+
+				// frames seen before need no work. plan the others and sort them by module and sequence
+				std::vector<task> tasks;
+				for( size_t i = 0; i < num_frames; ++i ) {
+					if( !imgs[i] ) continue;
+					image::symbol_map::iterator found = imgs[i]->known.find( vaddrs[i] );
+					if( found != imgs[i]->known.end() ) {
+						out[i] = found->second;
+					} else {
+						tasks.push_back( plan( imgs[i], vaddrs[i], i, tasks.size() ) );
+					}
+				}
+				std::sort( tasks.begin(), tasks.end() );
+				std::vector<size_t> jobs;
+				for( size_t i = 0; i < tasks.size(); ++i ) {
+					if( !i || tasks[i - 1] < tasks[i] ) jobs.push_back( i );
+				}
+				jobs.push_back( tasks.size() );
+
+				std::vector<std::string> texts( tasks.size() );
+				pool p;
+				p.tasks = &tasks;
+				p.jobs = &jobs;
+				p.texts = &texts;
+				p.next = 0;
+#if $on($cpp11)
+				size_t num_threads = HEAL_SYMBOLIZER_THREADS ? HEAL_SYMBOLIZER_THREADS : std::thread::hardware_concurrency();
+				num_threads = std::min( std::min( num_threads, jobs.size() - 1 ), tasks.size() / min_frames_per_thread + 1 );
+				if( forked ) num_threads = 1;
+				std::vector<std::thread> helpers;
+				for( size_t i = 1; i < num_threads; ++i ) {
+					helpers.push_back( std::thread( drain_thread, &p ) );
+				}
+				drain( &p );
+				for( size_t i = 0; i < helpers.size(); ++i ) {
+					helpers[i].join();
+				}
+#else
+				drain( &p );
+#endif
 
-std::string timestamp() {
-	std::stringstream ss;
-	ss << __TIMESTAMP__;
-	return ss.str();
-}
+				for( size_t i = 0; i < tasks.size(); ++i ) {
+					const task &t = tasks[i];
+					t.img->known[ t.vaddr ] = texts[ t.slot ];
+					append_cache( *t.img, t.vaddr, texts[ t.slot ] );
+					out[ t.frame ] = texts[ t.slot ];
+				}
+			}
 
-/*
- * Simple prompt dialog (based on legolas558's code). zlib/libpng license.
- * - rlyeh
- */
+			// resolves every frame of this process in one pass. unknown frames are left empty.
+			static void resolve( void *const *frames, size_t num_frames, std::vector<std::string> &out ) {
+				self().mutex.lock();
+				std::vector<image *> imgs( num_frames );
+				std::vector<uintptr_t> vaddrs( num_frames );
+				for( size_t i = 0; i < num_frames; ++i ) {
+					imgs[i] = find( uintptr_t( frames[i] ), vaddrs[i] );
+				}
+				if( num_frames ) resolve( &imgs[0], &vaddrs[0], num_frames, out );
+				self().mutex.unlock();
+			}
+		}
+#endif
 
-#if !$on($windows)
+		bool symbolize( const std::string &module, const std::string &build_id, const std::vector<uintptr_t> &addresses, std::vector<std::string> &out ) {
+#if HEAL_SYMBOLIZER
+			elf::self().mutex.lock();
+			elf::image *img = elf::load( module );
+			bool ok = img && !img->loads.empty() && ( build_id.empty() || build_id == img->build_id );
+			if( ok ) {
+				out.assign( addresses.size(), std::string() );
+				std::vector<elf::image *> imgs( addresses.size(), img );
+				if( !addresses.empty() ) elf::resolve( &imgs[0], &addresses[0], addresses.size(), out );
+			}
+			elf::self().mutex.unlock();
+			return ok;
+#else
+			return false;
+#endif
+		}
 
-std::string prompt( const std::string &current_value, const std::string &title, const std::string &caption )
-{
-	std::string out;
+		void forked_symbolizer() {
+#if HEAL_SYMBOLIZER
+			elf::forked = true;
+			// a lock held at fork() belongs to a thread the child does not have, and the state it guards may be half written
+			if( elf::self().mutex.try_lock() ) elf::self().mutex.unlock();
+			else elf::instance() = new elf::state();
+#endif
+		}
 
-	if( has("whiptail") && false )
-	{
-		std::string out = pipe( std::string() +
-			"/usr/bin/whiptail 3>&1 1>&2 2>&3 --title \"" +title+ "\" --inputbox \"" +caption+ "\" 0 0 \"" +current_value+ "\"" );
-	}
-	else
-	{
-		if( title.size() && caption.size() )
-			fprintf(stdout, "%s", title.c_str());
-		else
-			fprintf(stdout, "%s", title.empty() ? caption.c_str() : title.c_str());
+		void lock_unwinder() {
+#if HEAL_CFI
+			cfi::modules_mutex.lock();
+#endif
+		}
+		void unlock_unwinder() {
+#if HEAL_CFI
+			cfi::modules_mutex.unlock();
+#endif
+		}
 
-		if( !current_value.empty() )
-			fprintf(stdout, " (enter defaults to '%s')", current_value.c_str());
+		callstack::callstack( bool autosave ) {
+			if( autosave ) save();
+		}
 
-		fprintf(stdout, "%s", "\n");
+		size_t callstack::space() const {
+			return sizeof(frames) + sizeof(void *) * frames.size();
+		}
 
-		std::getline( std::cin, out );
+		void callstack::save( unsigned frames_to_skip ) {
 
-		if( out.empty() )
-			out = current_value;
-	}
+			if( frames_to_skip > max_frames )
+				return;
 
-	return out;
-}
+			void *walked[ max_frames ];
+			unsigned n = capture( walked, max_frames, frames_to_skip );
+			frames.assign( walked, walked + n );
+		}
 
-#endif
+		unsigned callstack::capture( void **out_frames, unsigned capacity, unsigned frames_to_skip ) {
 
-#if $on($msvc)
-#   pragma warning( push )
-#   pragma warning( disable : 4996 )
+			if( frames_to_skip > capacity )
+				return 0;
+
+#if HEAL_FRAME_POINTERS || HEAL_CFI
+			{
+#if HEAL_FRAME_POINTERS
+				unsigned n = walk_frame_pointers( out_frames, capacity, frames_to_skip );
+#else
+				unsigned n = cfi::walk( out_frames, capacity, frames_to_skip );
+#endif
+				if( n != ~0u ) {
+					return n;
+				}
+			}
 #endif
 
-#if $on($windows)
-#   pragma comment(lib,"user32.lib")
-#   pragma comment(lib,"gdi32.lib")
-//$warning("<heal/heal.cpp> says: dialog aware dpi fix (@todo)")
+			$windows({
+				// RtlCaptureStackBackTrace is only available on Windows XP or newer versions of Windows
+				typedef WORD(NTAPI FuncRtlCaptureStackBackTrace)(DWORD, DWORD, PVOID *, PDWORD);
 
-std::string prompt( const std::string &current_value, const std::string &title, const std::string &caption )
-{
-	class InputBox
-	{
-		private:
+				static struct raii
+				{
+					raii() : module(0), ptrRtlCaptureStackBackTrace(0)
+					{
+						module = LoadLibraryA("kernel32.dll");
+						if( !module )
+							fail( "<heal/heal.cpp> says: error! cant load kernel32.dll" );
 
-		HWND                hwndParent,
-							hwndInputBox,
-							hwndQuery,
-							hwndOk,
-							hwndCancel,
-							hwndEditBox;
-		LPSTR               szInputText;
-		WORD                wInputMaxLength, wInputLength;
-		bool                bRegistered,
-							bResult;
+						ptrRtlCaptureStackBackTrace = (FuncRtlCaptureStackBackTrace *)GetProcAddress(module, "RtlCaptureStackBackTrace");
+						if( !ptrRtlCaptureStackBackTrace )
+							fail( "<heal/heal.cpp> says: error! cant find RtlCaptureStackBackTrace() process address" );
+					}
+					~raii() { if(module) FreeLibrary(module); }
 
-		HINSTANCE           hThisInstance;
+					HMODULE module;
+					FuncRtlCaptureStackBackTrace *ptrRtlCaptureStackBackTrace;
+				} module;
 
-		enum
+				if( !module.ptrRtlCaptureStackBackTrace )
+					return 0;
+				return module.ptrRtlCaptureStackBackTrace(frames_to_skip+1, capacity, out_frames, (DWORD *) 0);
+			})
+			$gnuc({
+				int n = backtrace(out_frames, int(capacity));
+				return n > 0 ? unsigned(n) : 0;
+			})
+			return 0;
+		}
+
+		std::vector<std::string> callstack::unwind( unsigned from, unsigned to ) const
 		{
-			CIB_SPAN = 10,
-			CIB_LEFT_OFFSET = 6,
-			CIB_TOP_OFFSET = 4,
-			CIB_WIDTH = 300,
-			CIB_HEIGHT = 130,
-			CIB_BTN_WIDTH = 60,
-			CIB_BTN_HEIGHT = 20
-		};
+			if( to == ~0 )
+				to = this->frames.size();
 
-		public:
+			if( from > to || from > this->frames.size() || to > this->frames.size() )
+				return std::vector<std::string>();
 
-#       define CIB_CLASS_NAME   "CInputBoxA"
+			const size_t num_frames = to - from;
+			std::vector<std::string> backtraces( num_frames );
 
-		static LRESULT CALLBACK CIB_WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
-		{
-			InputBox *self;
-			self = (InputBox *)GetWindowLongPtr(hWnd, GWLP_USERDATA);
+			void * const * frames = &this->frames[ from ];
+			const std::string invalid = "????";
 
-			switch (msg)
-			{
-				case WM_CREATE:
-					self = (InputBox *) ((CREATESTRUCT *)lParam)->lpCreateParams;
-					SetWindowLongPtr(hWnd, GWLP_USERDATA, (LONG_PTR)self);
-					self->create(hWnd);
-				break;
-				case WM_COMMAND:
-					switch(LOWORD(wParam)) {
-						case IDOK:
-							self->submit();
-						case IDCANCEL:
-							self->close();
-						break;
-					}
-					break;
-				case WM_CLOSE:
-					self->close();
-					return 0;
-				case WM_DESTROY:
-					self->destroy();
-					break;
-			}
-			return(DefWindowProc (hWnd, msg, wParam, lParam));
-		}
+			$windows({
+				SymSetOptions(SYMOPT_UNDNAME);
 
-		InputBox( HINSTANCE hInst ) :
-			hwndParent(0),
-			hwndInputBox(0),
-			hwndQuery(0),
-			hwndOk(0),
-			hwndCancel(0),
-			hwndEditBox(0),
-			szInputText(0),
-			wInputMaxLength(0), wInputLength(0),
-			bRegistered(false),
-			bResult(false),
-			hThisInstance(hInst)
-		{
-			WNDCLASSEXA wndInputBox;
-			RECT rect;
+				$no(
+					// polite version. this is how things should be done.
+					HANDLE process = GetCurrentProcess();
+					if( SymInitialize( process, NULL, TRUE ) )
+				)
+				$yes(
+					// this is what we have to do because other memory managers are not polite enough. fuck them off
+					static HANDLE process = GetCurrentProcess();
+					static int init = SymInitialize( process, NULL, TRUE );
+					if( !init )
+						fail( "<heal/heal.cpp> says: cannot initialize Dbghelp.lib" );
+				)
+				{
+					enum { MAXSYMBOLNAME = 512 - sizeof(IMAGEHLP_SYMBOL64) };
+					char symbol64_buf     [ 512 ];
+					char symbol64_bufblank[ 512 ] = {0};
+					IMAGEHLP_SYMBOL64 *symbol64       = reinterpret_cast<IMAGEHLP_SYMBOL64*>(symbol64_buf);
+					IMAGEHLP_SYMBOL64 *symbol64_blank = reinterpret_cast<IMAGEHLP_SYMBOL64*>(symbol64_bufblank);
+					symbol64_blank->SizeOfStruct = sizeof(IMAGEHLP_SYMBOL64);
+					symbol64_blank->MaxNameLength = (MAXSYMBOLNAME-1) / 2; //wchar?
 
-			memset(&wndInputBox, 0, sizeof(WNDCLASSEXA));
+					IMAGEHLP_LINE64 line64, line64_blank = {0};
+					line64_blank.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
 
-			hThisInstance = hInst;
+					for( unsigned i = 0; i < num_frames; i++ ) {
+						*symbol64 = *symbol64_blank;
+						DWORD64 displacement64 = 0;
 
-			wndInputBox.cbSize                  = sizeof(wndInputBox);
-			wndInputBox.lpszClassName           = CIB_CLASS_NAME;
-			wndInputBox.style                   = CS_HREDRAW | CS_VREDRAW;
-			wndInputBox.lpfnWndProc             = CIB_WndProc;
-			wndInputBox.lpszMenuName            = NULL;
-			wndInputBox.hIconSm                 = NULL;
-			wndInputBox.cbClsExtra              = 0;
-			wndInputBox.cbWndExtra              = 0;
-			wndInputBox.hInstance               = hInst;
-			wndInputBox.hIcon                   = LoadIcon(NULL, IDI_WINLOGO);
-			wndInputBox.hCursor                 = LoadCursor(NULL, IDC_ARROW);
-			wndInputBox.hbrBackground           = (HBRUSH)(COLOR_WINDOW);
+						if( SymGetSymFromAddr64( process, (DWORD64) frames[i], &displacement64, symbol64 ) ) {
+							line64 = line64_blank;
+							DWORD displacement = 0;
+							if( SymGetLineFromAddr64( process, (DWORD64) frames[i], &displacement, &line64 ) ) {
+								backtraces[i] = heal::sfstring( "\1 (\2:\3)", symbol64->Name, line64.FileName, line64.LineNumber );
+							} else {
+								backtraces[i] = symbol64->Name;
+							}
+						} else  backtraces[i] = invalid;
+					}
 
-			RegisterClassExA(&wndInputBox);
+					$no(
+						// fuck the others. cleanup commented.
+						SymCleanup(process);
+					)
+				}
+				DWORD error = GetLastError();
 
-			if (hwndParent)
-				GetWindowRect(hwndParent, &rect); //always false?
-			else
-				GetWindowRect(GetDesktopWindow(), &rect);
+				return backtraces;
+			})
+			$gnuc({
+#if HEAL_SYMBOLIZER
+				elf::resolve( frames, num_frames, backtraces );
+#endif
+				char **strings = 0;
 
-			hwndInputBox = CreateWindowA( CIB_CLASS_NAME, "",
-							(WS_BORDER | WS_CAPTION), rect.left+(rect.right-rect.left-CIB_WIDTH)/2,
-							rect.top+(rect.bottom-rect.top-CIB_HEIGHT)/2,
-							CIB_WIDTH, CIB_HEIGHT, hwndParent, NULL,
-							hThisInstance, this);
-		}
+				// Decode the strings (of frames the symbolizer could not resolve)
+				for( unsigned i = 0; i < num_frames; i++ ) {
+					if( backtraces[i].empty() ) {
+						if( !strings && !( strings = backtrace_symbols(frames, num_frames) ) ) break;
+						backtraces[i] = ( strings[i] ? demangle(strings[i]) : invalid );
+					}
+				}
+				free( strings );
 
-		void destroy()
-		{
-			EnableWindow(hwndParent, true);
-			SendMessage(hwndInputBox, WM_CLOSE/*WM_DESTROY*/, 0, 0);
+				return backtraces;
+			})
+
+			return backtraces;
 		}
 
-		~InputBox()
-		{
-			UnregisterClassA(CIB_CLASS_NAME, hThisInstance);
+		std::vector<std::string> callstack::str( const char *format12, size_t skip_begin ) const {
+			callstack copy = *this;
+			std::vector<std::string> stacktrace = copy.unwind( skip_begin );
+
+			for( size_t i = 0, end = stacktrace.size(); i < end; i++ )
+				stacktrace[i] = heal::sfstring( format12, i + 1, stacktrace[i] );
+
+			return stacktrace;
 		}
 
-		void submit()
-		{
-			wInputLength = (int)SendMessage(hwndEditBox, EM_LINELENGTH, 0, 0);
-			if (wInputLength) {
-				*((LPWORD)szInputText) = wInputMaxLength;
-				wInputLength = (WORD)SendMessage(hwndEditBox, EM_GETLINE, 0, (LPARAM)szInputText);
+		std::string callstack::flat( const char *format12, size_t skip_begin ) const {
+			std::vector<std::string> vec = str( format12, skip_begin );
+			std::string str;
+			for( std::vector<std::string>::const_iterator it = vec.begin(), end = vec.end(); it != end; ++it ) {
+				str += *it;
 			}
-			szInputText[wInputLength] = '\0';
-			bResult = true;
+			return str;
 		}
 
-		void create(HWND hwndNew)
-		{
-			static HFONT myFont = NULL;
+std::vector<std::string> stacktrace( const char *format12, size_t skip_initial ) {
+	return callstack(true).str( format12, skip_initial );
+}
 
-			if( myFont != NULL )
-			{
-				DeleteObject( myFont );
-				myFont = NULL;
-			}
+std::string stackstring( const char *format12, size_t skip_initial ) {
+	std::string out;
+	std::vector<std::string> stack = stacktrace( format12, skip_initial );
+	for( std::vector<std::string>::const_iterator it = stack.begin(), end = stack.end(); it != end; ++it ) {
+		out += *it;
+	}
+	return out;
+}
 
-			hwndInputBox = hwndNew;
+// DIE
 
-			NONCLIENTMETRICS ncm;
-			ncm.cbSize = sizeof(NONCLIENTMETRICS);
+void die( const std::string &reason, int errorcode )
+{
+	if( !reason.empty() ) {
+		fail( reason );
+	}
 
-			if (SystemParametersInfo(SPI_GETNONCLIENTMETRICS, sizeof(NONCLIENTMETRICS), &ncm, 0))
-			{
-#if 0
-				LOGFONT lf;
-				memset(&lf,0,sizeof(LOGFONT));
+	$windows(
+	FatalExit( errorcode );
+	)
 
-				lf.lfWeight= FW_NORMAL;
-				lf.lfCharSet= ANSI_CHARSET;
-				//lf.lfPitchAndFamily = 35;
-				lf.lfHeight= 10;
-				strcpy(lf.lfFaceName, "Tahoma");
-				myFont=CreateFontIndirect(&lf);
-#else
-				myFont = CreateFontIndirect(&ncm.lfMessageFont);
-#endif
-			}
-			else
-			{
-				myFont = (HFONT)GetStockObject(DEFAULT_GUI_FONT);
-			}
-
-			//  SetWindowPos(hwndInputBox, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE);
-			hwndQuery = CreateWindowA("Static", "", WS_CHILD | WS_VISIBLE,
-									CIB_LEFT_OFFSET, CIB_TOP_OFFSET,
-									CIB_WIDTH-CIB_LEFT_OFFSET*2, CIB_BTN_HEIGHT*2,
-									hwndInputBox, NULL,
-									hThisInstance, NULL);
-			hwndEditBox = CreateWindowA("Edit", "", WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL | ES_LEFT, CIB_LEFT_OFFSET,
-									CIB_TOP_OFFSET + CIB_BTN_HEIGHT*2, CIB_WIDTH-CIB_LEFT_OFFSET*3, CIB_BTN_HEIGHT,
-									hwndInputBox,   NULL,
-									hThisInstance, NULL);
-			hwndOk = CreateWindowA("Button", "OK", WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_PUSHBUTTON,
-									CIB_WIDTH/2 - CIB_SPAN*2 - CIB_BTN_WIDTH, CIB_HEIGHT - CIB_TOP_OFFSET*4 - CIB_BTN_HEIGHT*2,
-									CIB_BTN_WIDTH, CIB_BTN_HEIGHT, hwndInputBox, (HMENU)IDOK,
-									hThisInstance, NULL);
-			hwndCancel = CreateWindowA("Button", "Cancel",
-									WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_PUSHBUTTON,
-									CIB_WIDTH/2 + CIB_SPAN, CIB_HEIGHT - CIB_TOP_OFFSET*4 - CIB_BTN_HEIGHT*2,  CIB_BTN_WIDTH, CIB_BTN_HEIGHT,
-									hwndInputBox, (HMENU)IDCANCEL,
-									hThisInstance, NULL);
-
-		//  SendMessage(hwndInputBox,WM_SETFONT,(WPARAM)myFont,FALSE);
-			SendMessage(hwndQuery,WM_SETFONT,(WPARAM)myFont,FALSE);
-			SendMessage(hwndEditBox,WM_SETFONT,(WPARAM)myFont,FALSE);
-			SendMessage(hwndOk,WM_SETFONT,(WPARAM)myFont,FALSE);
-			SendMessage(hwndCancel,WM_SETFONT,(WPARAM)myFont,FALSE);
-		}
+	// fallback
+	std::exit( errorcode );
+}
 
-		void close()
-		{
-			PostMessage(hwndInputBox, WM_CLOSE, 0, 0);
-		}
+void die( int errorcode, const std::string &reason )
+{
+	die( reason, errorcode );
+}
 
-		void hide()
-		{
-			ShowWindow(hwndInputBox, SW_HIDE);
-		}
+// HEXDUMP
+// @todo: maxwidth != 80 doesnt work
 
-		void show(LPCSTR lpszTitle, LPCSTR  lpszQuery)
-		{
-			SetWindowTextA(hwndInputBox, lpszTitle);
-			SetWindowTextA(hwndEditBox, szInputText);
-			SetWindowTextA(hwndQuery, lpszQuery);
-			SendMessage(hwndEditBox, EM_LIMITTEXT, wInputMaxLength, 0);
-			SendMessage(hwndEditBox, EM_SETSEL, 0, -1);
-			SetFocus(hwndEditBox);
-			ShowWindow(hwndInputBox, SW_NORMAL);
-		}
+std::string hexdump( const void *data, size_t num_bytes, const void *self )
+{
+#   ifdef _MSC_VER
+#       pragma warning( push )
+#       pragma warning( disable : 4996 )
+#       define $vsnprintf _vsnprintf
+#   else
+#       define $vsnprintf  vsnprintf
+#   endif
 
-		int show(HWND hwndParentWindow, LPCSTR lpszTitle, LPCSTR lpszQuery, LPSTR szResult, WORD wMax)
+	struct local {
+		static std::string format( const char *fmt, ... )
 		{
-			MSG msg;
-			BOOL    bRet;
-			hwndParent = hwndParentWindow;
-			szInputText = szResult;
-			wInputMaxLength = wMax;
+			int len;
+			std::string self;
 
-			bResult = false;
+			using namespace std;
 
-		//  EnableWindow(hwndParent, false);
+			// Calculate the final length of the formatted string
+			{
+				va_list args;
+				va_start( args, fmt );
+				len = $vsnprintf( 0, 0, fmt, args );
+				va_end( args );
+			}
 
-			show(lpszTitle, lpszQuery);
+			// Allocate a buffer (including room for null termination
+			char* target_string = new char[++len];
 
-			while( (bRet = GetMessageA( &msg, NULL, 0, 0 )) != 0)
+			// Generate the formatted string
 			{
-				if (msg.message==WM_KEYDOWN) {
-					switch (msg.wParam) {
-					case VK_RETURN:
-						submit();
-					case VK_ESCAPE:
-						close();
-						break;
-					default:
-						TranslateMessage(&msg);
-						break;
-					}
-				} else
-		//      if (!IsDialogMessage(hwndInputBox, &msg)) {
-					TranslateMessage(&msg);
-		//      }
-				DispatchMessage(&msg);
-				if (msg.message == WM_CLOSE)
-					break;
+				va_list args;
+				va_start( args, fmt );
+				$vsnprintf( target_string, len, fmt, args );
+				va_end( args );
 			}
 
-		//  EnableWindow(hwndParent, true);
+			// Assign the formatted string
+			self.assign( target_string );
 
-			return bResult;
-		}
+			// Clean up
+			delete [] target_string;
 
-	#   undef CIB_CLASS_NAME
-	}
-	myinp(GetModuleHandle(0));
+			return self;
+		}
+	};
 
-	char *result = new char [2048+1];
+	unsigned maxwidth = 80;
+	unsigned width = 16; //column width
+	unsigned width_offset_block = (8 + 1);
+	unsigned width_chars_block  = (width * 3 + 1) + sizeof("asc");
+	unsigned width_hex_block    = (width * 3 + 1) + sizeof("hex");
+	unsigned width_padding = (std::max)( 0, int( maxwidth - ( width_offset_block + width_chars_block + width_hex_block ) ) );
+	unsigned blocks = width_padding / ( width_chars_block + width_hex_block ) ;
 
-	memset( result, 0, 2048+1 ); //default value
+	unsigned dumpsize = ( num_bytes < width * 16 ? num_bytes : width * 16 ); //16 lines max
 
-	strcpy( result, current_value.c_str() );
+	std::string result;
 
-	myinp.show(0, "L", caption.size() ? caption.c_str() : title.c_str(), result, 2048);
+	result += local::format( "%-*s %-.*s [ptr=%p sz=%d]\n", width_offset_block - 1, "offset", width_chars_block - 1, "00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F", self ? self : data, num_bytes );
 
-	std::string _r = result;
+	if( !num_bytes )
+		return result;
 
-	delete [] result;
+	blocks++;
 
-	return _r;
-}
+	const unsigned char *p = reinterpret_cast<const unsigned char *>( data );
+	size_t i = 0;
 
-#endif
+	while( i < dumpsize )
+	{
+		//offset block
+		result += local::format("%p ", (size_t)(p + i) ); //%08x, %08zx
 
-}
+		//chars blocks
+		for( unsigned b = 0; b < blocks; b++)
+		{
+			for( unsigned c = 0 ; c < width ; c++ )
+				result += local::format(" %c ", i + c >= dumpsize ? '.' : p[i + c] < 32 || p[i + c] >= 127 ? '.' : p[i + c]);
 
-#if $on($msvc)
-#   pragma warning( pop )
-#endif
+			result += "asc\n";
+		}
 
-/*
-#undef $debug
-#undef $release
-#undef $other
-#undef $gnuc
-#undef $msvc
+		//offset block
+		result += local::format("%p ", (size_t)(p + i) ); //%08x, %08zx
 
-#undef $undefined
-#undef $apple
-#undef $linux
-#undef $windows
+		//hex blocks
+		for( unsigned b = 0; b < blocks; b++)
+		{
+			for( unsigned c = 0; c < width ; c++)
+				result += local::format( i + c < dumpsize ? "%02x " : "?? ", p[i + c]);
 
-#undef $no
-#undef $yes
-*/
+			result += "hex\n";
+		}
 
+		//next line
+		//result += '\n';
+		i += width * blocks;
+	}
 
-// }
+	return result;
 
-// mutexes and threads
-#if $on($cpp11)
-#include <mutex>
-#include <thread>
-#else
-#include <boost/thread/recursive_mutex.hpp>
-#include <boost/thread/thread.hpp>
-namespace std {
-	using boost::thread;
-	using boost::recursive_mutex;
+#   undef $vsnprintf
+#   ifdef _MSC_VER
+#       pragma warning( pop )
+#   endif
 }
-#endif
 
-// external; route66 uses c++11
-#if kTraceyWebserverPort
-
-//#line 1 "route66.cpp"
-// lightweight http server
-// - rlyeh, zlib/libpng licensed. based on code by Ivan Tikhonov (zlib licensed)
+std::string timestamp() {
+	std::stringstream ss;
+	ss << __TIMESTAMP__;
+	return ss.str();
+}
 
-// Sockets, taken from https://github.com/r-lyeh/knot
+/*
+ * Simple prompt dialog (based on legolas558's code). zlib/libpng license.
+ * - rlyeh
+ */
 
-#if defined(_WIN32)
+#if !$on($windows)
 
-#   include <winsock2.h>
-#   include <ws2tcpip.h>
-#   include <windows.h>
+std::string prompt( const std::string &current_value, const std::string &title, const std::string &caption )
+{
+	std::string out;
 
-#   ifndef _MSC_VER
-	static
-	const char* inet_ntop(int af, const void* src, char* dst, int cnt){
-		struct sockaddr_in srcaddr;
-		memset(&srcaddr, 0, sizeof(struct sockaddr_in));
-		memcpy(&(srcaddr.sin_addr), src, sizeof(srcaddr.sin_addr));
-		srcaddr.sin_family = af;
-		if (WSAAddressToString((struct sockaddr*) &srcaddr, sizeof(struct sockaddr_in), 0, dst, (LPDWORD) &cnt) != 0) {
-			DWORD rv = WSAGetLastError();
-			return NULL;
-		}
-		return dst;
+	if( has("whiptail") && false )
+	{
+		std::string out = pipe( std::string() +
+			"/usr/bin/whiptail 3>&1 1>&2 2>&3 --title \"" +title+ "\" --inputbox \"" +caption+ "\" 0 0 \"" +current_value+ "\"" );
 	}
-#   endif
+	else
+	{
+		if( title.size() && caption.size() )
+			fprintf(stdout, "%s", title.c_str());
+		else
+			fprintf(stdout, "%s", title.empty() ? caption.c_str() : title.c_str());
 
-#   pragma comment(lib,"ws2_32.lib")
+		if( !current_value.empty() )
+			fprintf(stdout, " (enter defaults to '%s')", current_value.c_str());
 
-#   define INIT()                    do { static WSADATA wsa_data; static const int init = WSAStartup( MAKEWORD(2, 2), &wsa_data ); } while(0)
-#   define SOCKET(A,B,C)             ::socket((A),(B),(C))
-#   define ACCEPT(A,B,C)             ::accept((A),(B),(C))
-#   define CONNECT(A,B,C)            ::connect((A),(B),(C))
-#   define CLOSE(A)                  ::closesocket((A))
-#   define RECV(A,B,C,D)             ::recv((A), (char *)(B), (C), (D))
-#   define READ(A,B,C)               ::recv((A), (char *)(B), (C), (0))
-#   define SELECT(A,B,C,D,E)         ::select((A),(B),(C),(D),(E))
-#   define SEND(A,B,C,D)             ::send((A), (const char *)(B), (int)(C), (D))
-#   define WRITE(A,B,C)              ::send((A), (const char *)(B), (int)(C), (0))
-#   define GETSOCKOPT(A,B,C,D,E)     ::getsockopt((A),(B),(C),(char *)(D), (int*)(E))
-#   define SETSOCKOPT(A,B,C,D,E)     ::setsockopt((A),(B),(C),(char *)(D), (int )(E))
+		fprintf(stdout, "%s", "\n");
 
-#   define BIND(A,B,C)               ::bind((A),(B),(C))
-#   define LISTEN(A,B)               ::listen((A),(B))
-#   define SHUTDOWN(A)               ::shutdown((A),2)
-#   define SHUTDOWN_R(A)             ::shutdown((A),0)
-#   define SHUTDOWN_W(A)             ::shutdown((A),1)
+		std::getline( std::cin, out );
 
-	namespace
+		if( out.empty() )
+			out = current_value;
+	}
+
+	return out;
+}
+
+#endif
+
+#if $on($msvc)
+#   pragma warning( push )
+#   pragma warning( disable : 4996 )
+#endif
+
+#if $on($windows)
+#   pragma comment(lib,"user32.lib")
+#   pragma comment(lib,"gdi32.lib")
+//$warning("<heal/heal.cpp> says: dialog aware dpi fix (@todo)")
+
+std::string prompt( const std::string &current_value, const std::string &title, const std::string &caption )
+{
+	class InputBox
 	{
-		// fill missing api
+		private:
+
+		HWND                hwndParent,
+							hwndInputBox,
+							hwndQuery,
+							hwndOk,
+							hwndCancel,
+							hwndEditBox;
+		LPSTR               szInputText;
+		WORD                wInputMaxLength, wInputLength;
+		bool                bRegistered,
+							bResult;
+
+		HINSTANCE           hThisInstance;
 
 		enum
 		{
-			F_GETFL = 0,
-			F_SETFL = 1,
-
-			O_NONBLOCK = 128 // dummy
+			CIB_SPAN = 10,
+			CIB_LEFT_OFFSET = 6,
+			CIB_TOP_OFFSET = 4,
+			CIB_WIDTH = 300,
+			CIB_HEIGHT = 130,
+			CIB_BTN_WIDTH = 60,
+			CIB_BTN_HEIGHT = 20
 		};
 
-		int fcntl( int &sockfd, int mode, int value )
-		{
-			if( mode == F_GETFL ) // get socket status flags
-				return 0; // original return current sockfd flags
+		public:
 
-			if( mode == F_SETFL ) // set socket status flags
-			{
-				u_long iMode = ( value & O_NONBLOCK ? 0 : 1 );
+#       define CIB_CLASS_NAME   "CInputBoxA"
 
-				bool result = ( ioctlsocket( sockfd, FIONBIO, &iMode ) == NO_ERROR );
+		static LRESULT CALLBACK CIB_WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
+		{
+			InputBox *self;
+			self = (InputBox *)GetWindowLongPtr(hWnd, GWLP_USERDATA);
 
-				return 0;
+			switch (msg)
+			{
+				case WM_CREATE:
+					self = (InputBox *) ((CREATESTRUCT *)lParam)->lpCreateParams;
+					SetWindowLongPtr(hWnd, GWLP_USERDATA, (LONG_PTR)self);
+					self->create(hWnd);
+				break;
+				case WM_COMMAND:
+					switch(LOWORD(wParam)) {
+						case IDOK:
+							self->submit();
+						case IDCANCEL:
+							self->close();
+						break;
+					}
+					break;
+				case WM_CLOSE:
+					self->close();
+					return 0;
+				case WM_DESTROY:
+					self->destroy();
+					break;
 			}
-
-			return 0;
+			return(DefWindowProc (hWnd, msg, wParam, lParam));
 		}
-	}
 
-#else
+		InputBox( HINSTANCE hInst ) :
+			hwndParent(0),
+			hwndInputBox(0),
+			hwndQuery(0),
+			hwndOk(0),
+			hwndCancel(0),
+			hwndEditBox(0),
+			szInputText(0),
+			wInputMaxLength(0), wInputLength(0),
+			bRegistered(false),
+			bResult(false),
+			hThisInstance(hInst)
+		{
+			WNDCLASSEXA wndInputBox;
+			RECT rect;
 
-#   include <fcntl.h>
-#   include <sys/types.h>
-#   include <sys/socket.h>
-#   include <netdb.h>
-#   include <unistd.h>    //close
+			memset(&wndInputBox, 0, sizeof(WNDCLASSEXA));
 
-#   include <arpa/inet.h> //inet_addr, inet_ntop
+			hThisInstance = hInst;
 
-#   define INIT()                    do {} while(0)
-#   define SOCKET(A,B,C)             ::socket((A),(B),(C))
-#   define ACCEPT(A,B,C)             ::accept((A),(B),(C))
-#   define CONNECT(A,B,C)            ::connect((A),(B),(C))
-#   define CLOSE(A)                  ::close((A))
-#   define READ(A,B,C)               ::read((A),(B),(C))
-#   define RECV(A,B,C,D)             ::recv((A), (void *)(B), (C), (D))
-#   define SELECT(A,B,C,D,E)         ::select((A),(B),(C),(D),(E))
-#   define SEND(A,B,C,D)             ::send((A), (const int8 *)(B), (C), (D))
-#   define WRITE(A,B,C)              ::write((A),(B),(C))
-#   define GETSOCKOPT(A,B,C,D,E)     ::getsockopt((int)(A),(int)(B),(int)(C),(      void *)(D),(socklen_t *)(E))
-#   define SETSOCKOPT(A,B,C,D,E)     ::setsockopt((int)(A),(int)(B),(int)(C),(const void *)(D),(int)(E))
+			wndInputBox.cbSize                  = sizeof(wndInputBox);
+			wndInputBox.lpszClassName           = CIB_CLASS_NAME;
+			wndInputBox.style                   = CS_HREDRAW | CS_VREDRAW;
+			wndInputBox.lpfnWndProc             = CIB_WndProc;
+			wndInputBox.lpszMenuName            = NULL;
+			wndInputBox.hIconSm                 = NULL;
+			wndInputBox.cbClsExtra              = 0;
+			wndInputBox.cbWndExtra              = 0;
+			wndInputBox.hInstance               = hInst;
+			wndInputBox.hIcon                   = LoadIcon(NULL, IDI_WINLOGO);
+			wndInputBox.hCursor                 = LoadCursor(NULL, IDC_ARROW);
+			wndInputBox.hbrBackground           = (HBRUSH)(COLOR_WINDOW);
 
-#   define BIND(A,B,C)               ::bind((A),(B),(C))
-#   define LISTEN(A,B)               ::listen((A),(B))
-#   define SHUTDOWN(A)               ::shutdown((A),SHUT_RDWR)
-#   define SHUTDOWN_R(A)             ::shutdown((A),SHUT_RD)
-#   define SHUTDOWN_W(A)             ::shutdown((A),SHUT_WR)
+			RegisterClassExA(&wndInputBox);
 
-#endif
+			if (hwndParent)
+				GetWindowRect(hwndParent, &rect); //always false?
+			else
+				GetWindowRect(GetDesktopWindow(), &rect);
 
-#include <cstdlib>
-#include <cstring>
-#include <limits.h>
+			hwndInputBox = CreateWindowA( CIB_CLASS_NAME, "",
+							(WS_BORDER | WS_CAPTION), rect.left+(rect.right-rect.left-CIB_WIDTH)/2,
+							rect.top+(rect.bottom-rect.top-CIB_HEIGHT)/2,
+							CIB_WIDTH, CIB_HEIGHT, hwndParent, NULL,
+							hThisInstance, this);
+		}
 
-#include <fstream>
-#include <map>
-#include <sstream>
-#include <string>
-#include <vector>
+		void destroy()
+		{
+			EnableWindow(hwndParent, true);
+			SendMessage(hwndInputBox, WM_CLOSE/*WM_DESTROY*/, 0, 0);
+		}
 
+		~InputBox()
+		{
+			UnregisterClassA(CIB_CLASS_NAME, hThisInstance);
+		}
 
-//#line 1 "route66.hpp"
-// lightweight http server
-// - rlyeh, zlib/libpng licensed. based on code by Ivan Tikhonov (zlib licensed)
+		void submit()
+		{
+			wInputLength = (int)SendMessage(hwndEditBox, EM_LINELENGTH, 0, 0);
+			if (wInputLength) {
+				*((LPWORD)szInputText) = wInputMaxLength;
+				wInputLength = (WORD)SendMessage(hwndEditBox, EM_GETLINE, 0, (LPARAM)szInputText);
+			}
+			szInputText[wInputLength] = '\0';
+			bResult = true;
+		}
 
-/**/// <-- remove an asterisk in a code editor to highlight API
+		void create(HWND hwndNew)
+		{
+			static HFONT myFont = NULL;
 
-//#pragma once
+			if( myFont != NULL )
+			{
+				DeleteObject( myFont );
+				myFont = NULL;
+			}
 
-#include <map>
-#include <ostream>
-#include <string>
-#include <utility>
-#include <sstream>
+			hwndInputBox = hwndNew;
 
-// taken from https://github.com/r-lyeh/bridge {
-#if (__cplusplus < 201103L && !defined(_MSC_VER)) || (defined(_MSC_VER) && (_MSC_VER < 1700)) || (defined(__GLIBCXX__) && __GLIBCXX__ < 20130322L)
-#   include <boost/functional.hpp> // if old libstdc++ or msc libs are found, use boost::function
-#   include <boost/function.hpp>   //
-#   include <boost/thread.hpp>     // and boost::thread
-namespace std {
-	namespace placeholders {
-		//...
-	}
-	using namespace boost;
-}
-#else
-#   include <functional>       // else assume modern c++11 and use std::function<> instead
-#   include <mutex>            // and std::mutex
-#   include <thread>           // and std::thread
-#endif
-// }
+			NONCLIENTMETRICS ncm;
+			ncm.cbSize = sizeof(NONCLIENTMETRICS);
 
-namespace route66 {
+			if (SystemParametersInfo(SPI_GETNONCLIENTMETRICS, sizeof(NONCLIENTMETRICS), &ncm, 0))
+			{
+#if 0
+				LOGFONT lf;
+				memset(&lf,0,sizeof(LOGFONT));
 
-	/*/ request:: 'class'
-	/*/
-	struct request {
-		std::string data;                              /*/      .data 'raw received data, as is' /*/
-		std::string method;                            /*/    .method 'raw method ("GET HEAD POST PUT ...")' /*/
-		std::string url;                               /*/       .url 'raw request ("/search?req1=blabla&req2=what%20ever")' /*/
-		std::string uri;                               /*/      .path 'decoded path uri ("/search")' /*/
-		std::string options;                           /*/   .options 'raw GET/POST options url ("req1=blabla&req2=what%20ever")' /*/
-		std::map<std::string, std::string> arguments;  /*/ .arguments 'decoded options decoupled as arguments ( {"req1","blabla"}, {"req2","what ever"} )' /*/
+				lf.lfWeight= FW_NORMAL;
+				lf.lfCharSet= ANSI_CHARSET;
+				//lf.lfPitchAndFamily = 35;
+				lf.lfHeight= 10;
+				strcpy(lf.lfFaceName, "Tahoma");
+				myFont=CreateFontIndirect(&lf);
+#else
+				myFont = CreateFontIndirect(&ncm.lfMessageFont);
+#endif
+			}
+			else
+			{
+				myFont = (HFONT)GetStockObject(DEFAULT_GUI_FONT);
+			}
+
+			//  SetWindowPos(hwndInputBox, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE);
+			hwndQuery = CreateWindowA("Static", "", WS_CHILD | WS_VISIBLE,
+									CIB_LEFT_OFFSET, CIB_TOP_OFFSET,
+									CIB_WIDTH-CIB_LEFT_OFFSET*2, CIB_BTN_HEIGHT*2,
+									hwndInputBox, NULL,
+									hThisInstance, NULL);
+			hwndEditBox = CreateWindowA("Edit", "", WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL | ES_LEFT, CIB_LEFT_OFFSET,
+									CIB_TOP_OFFSET + CIB_BTN_HEIGHT*2, CIB_WIDTH-CIB_LEFT_OFFSET*3, CIB_BTN_HEIGHT,
+									hwndInputBox,   NULL,
+									hThisInstance, NULL);
+			hwndOk = CreateWindowA("Button", "OK", WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_PUSHBUTTON,
+									CIB_WIDTH/2 - CIB_SPAN*2 - CIB_BTN_WIDTH, CIB_HEIGHT - CIB_TOP_OFFSET*4 - CIB_BTN_HEIGHT*2,
+									CIB_BTN_WIDTH, CIB_BTN_HEIGHT, hwndInputBox, (HMENU)IDOK,
+									hThisInstance, NULL);
+			hwndCancel = CreateWindowA("Button", "Cancel",
+									WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_PUSHBUTTON,
+									CIB_WIDTH/2 + CIB_SPAN, CIB_HEIGHT - CIB_TOP_OFFSET*4 - CIB_BTN_HEIGHT*2,  CIB_BTN_WIDTH, CIB_BTN_HEIGHT,
+									hwndInputBox, (HMENU)IDCANCEL,
+									hThisInstance, NULL);
+
+		//  SendMessage(hwndInputBox,WM_SETFONT,(WPARAM)myFont,FALSE);
+			SendMessage(hwndQuery,WM_SETFONT,(WPARAM)myFont,FALSE);
+			SendMessage(hwndEditBox,WM_SETFONT,(WPARAM)myFont,FALSE);
+			SendMessage(hwndOk,WM_SETFONT,(WPARAM)myFont,FALSE);
+			SendMessage(hwndCancel,WM_SETFONT,(WPARAM)myFont,FALSE);
+		}
+
+		void close()
+		{
+			PostMessage(hwndInputBox, WM_CLOSE, 0, 0);
+		}
+
+		void hide()
+		{
+			ShowWindow(hwndInputBox, SW_HIDE);
+		}
+
+		void show(LPCSTR lpszTitle, LPCSTR  lpszQuery)
+		{
+			SetWindowTextA(hwndInputBox, lpszTitle);
+			SetWindowTextA(hwndEditBox, szInputText);
+			SetWindowTextA(hwndQuery, lpszQuery);
+			SendMessage(hwndEditBox, EM_LIMITTEXT, wInputMaxLength, 0);
+			SendMessage(hwndEditBox, EM_SETSEL, 0, -1);
+			SetFocus(hwndEditBox);
+			ShowWindow(hwndInputBox, SW_NORMAL);
+		}
+
+		int show(HWND hwndParentWindow, LPCSTR lpszTitle, LPCSTR lpszQuery, LPSTR szResult, WORD wMax)
+		{
+			MSG msg;
+			BOOL    bRet;
+			hwndParent = hwndParentWindow;
+			szInputText = szResult;
+			wInputMaxLength = wMax;
+
+			bResult = false;
+
+		//  EnableWindow(hwndParent, false);
+
+			show(lpszTitle, lpszQuery);
+
+			while( (bRet = GetMessageA( &msg, NULL, 0, 0 )) != 0)
+			{
+				if (msg.message==WM_KEYDOWN) {
+					switch (msg.wParam) {
+					case VK_RETURN:
+						submit();
+					case VK_ESCAPE:
+						close();
+						break;
+					default:
+						TranslateMessage(&msg);
+						break;
+					}
+				} else
+		//      if (!IsDialogMessage(hwndInputBox, &msg)) {
+					TranslateMessage(&msg);
+		//      }
+				DispatchMessage(&msg);
+				if (msg.message == WM_CLOSE)
+					break;
+			}
+
+		//  EnableWindow(hwndParent, true);
+
+			return bResult;
+		}
+
+	#   undef CIB_CLASS_NAME
+	}
+	myinp(GetModuleHandle(0));
+
+	char *result = new char [2048+1];
+
+	memset( result, 0, 2048+1 ); //default value
+
+	strcpy( result, current_value.c_str() );
+
+	myinp.show(0, "L", caption.size() ? caption.c_str() : title.c_str(), result, 2048);
+
+	std::string _r = result;
+
+	delete [] result;
+
+	return _r;
+}
+
+#endif
+
+}
+
+#if $on($msvc)
+#   pragma warning( pop )
+#endif
+
+/*
+#undef $debug
+#undef $release
+#undef $other
+#undef $gnuc
+#undef $msvc
+
+#undef $undefined
+#undef $apple
+#undef $linux
+#undef $windows
+
+#undef $no
+#undef $yes
+*/
+
+
+// }
+
+// mutexes, threads and atomics
+#if $on($cpp11)
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#else
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/thread.hpp>
+namespace std {
+	using boost::atomic;
+	using boost::mutex;
+	using boost::thread;
+	using boost::recursive_mutex;
+}
+#endif
+
+// external; route66 uses c++11
+#if kTraceyWebserverPort
+
+//#line 1 "route66.cpp"
+// lightweight http server
+// - rlyeh, zlib/libpng licensed. based on code by Ivan Tikhonov (zlib licensed)
+
+// Sockets, taken from https://github.com/r-lyeh/knot
+
+#if defined(_WIN32)
+
+#   include <winsock2.h>
+#   include <ws2tcpip.h>
+#   include <windows.h>
+
+#   ifndef _MSC_VER
+	static
+	const char* inet_ntop(int af, const void* src, char* dst, int cnt){
+		struct sockaddr_in srcaddr;
+		memset(&srcaddr, 0, sizeof(struct sockaddr_in));
+		memcpy(&(srcaddr.sin_addr), src, sizeof(srcaddr.sin_addr));
+		srcaddr.sin_family = af;
+		if (WSAAddressToString((struct sockaddr*) &srcaddr, sizeof(struct sockaddr_in), 0, dst, (LPDWORD) &cnt) != 0) {
+			DWORD rv = WSAGetLastError();
+			return NULL;
+		}
+		return dst;
+	}
+#   endif
+
+#   pragma comment(lib,"ws2_32.lib")
+
+#   define INIT()                    do { static WSADATA wsa_data; static const int init = WSAStartup( MAKEWORD(2, 2), &wsa_data ); } while(0)
+#   define SOCKET(A,B,C)             ::socket((A),(B),(C))
+#   define ACCEPT(A,B,C)             ::accept((A),(B),(C))
+#   define CONNECT(A,B,C)            ::connect((A),(B),(C))
+#   define CLOSE(A)                  ::closesocket((A))
+#   define RECV(A,B,C,D)             ::recv((A), (char *)(B), (C), (D))
+#   define READ(A,B,C)               ::recv((A), (char *)(B), (C), (0))
+#   define SELECT(A,B,C,D,E)         ::select((A),(B),(C),(D),(E))
+#   define SEND(A,B,C,D)             ::send((A), (const char *)(B), (int)(C), (D))
+#   define WRITE(A,B,C)              ::send((A), (const char *)(B), (int)(C), (0))
+#   define GETSOCKOPT(A,B,C,D,E)     ::getsockopt((A),(B),(C),(char *)(D), (int*)(E))
+#   define SETSOCKOPT(A,B,C,D,E)     ::setsockopt((A),(B),(C),(char *)(D), (int )(E))
+
+#   define BIND(A,B,C)               ::bind((A),(B),(C))
+#   define LISTEN(A,B)               ::listen((A),(B))
+#   define SHUTDOWN(A)               ::shutdown((A),2)
+#   define SHUTDOWN_R(A)             ::shutdown((A),0)
+#   define SHUTDOWN_W(A)             ::shutdown((A),1)
+
+	namespace
+	{
+		// fill missing api
+
+		enum
+		{
+			F_GETFL = 0,
+			F_SETFL = 1,
+
+			O_NONBLOCK = 128 // dummy
+		};
+
+		int fcntl( int &sockfd, int mode, int value )
+		{
+			if( mode == F_GETFL ) // get socket status flags
+				return 0; // original return current sockfd flags
+
+			if( mode == F_SETFL ) // set socket status flags
+			{
+				u_long iMode = ( value & O_NONBLOCK ? 0 : 1 );
+
+				bool result = ( ioctlsocket( sockfd, FIONBIO, &iMode ) == NO_ERROR );
+
+				return 0;
+			}
+
+			return 0;
+		}
+	}
+
+#else
+
+#   include <fcntl.h>
+#   include <sys/types.h>
+#   include <sys/socket.h>
+#   include <netdb.h>
+#   include <unistd.h>    //close
+
+#   include <arpa/inet.h> //inet_addr, inet_ntop
+
+#   define INIT()                    do {} while(0)
+#   define SOCKET(A,B,C)             ::socket((A),(B),(C))
+#   define ACCEPT(A,B,C)             ::accept((A),(B),(C))
+#   define CONNECT(A,B,C)            ::connect((A),(B),(C))
+#   define CLOSE(A)                  ::close((A))
+#   define READ(A,B,C)               ::read((A),(B),(C))
+#   define RECV(A,B,C,D)             ::recv((A), (void *)(B), (C), (D))
+#   define SELECT(A,B,C,D,E)         ::select((A),(B),(C),(D),(E))
+#   define SEND(A,B,C,D)             ::send((A), (const int8 *)(B), (C), (D))
+#   define WRITE(A,B,C)              ::write((A),(B),(C))
+#   define GETSOCKOPT(A,B,C,D,E)     ::getsockopt((int)(A),(int)(B),(int)(C),(      void *)(D),(socklen_t *)(E))
+#   define SETSOCKOPT(A,B,C,D,E)     ::setsockopt((int)(A),(int)(B),(int)(C),(const void *)(D),(int)(E))
+
+#   define BIND(A,B,C)               ::bind((A),(B),(C))
+#   define LISTEN(A,B)               ::listen((A),(B))
+#   define SHUTDOWN(A)               ::shutdown((A),SHUT_RDWR)
+#   define SHUTDOWN_R(A)             ::shutdown((A),SHUT_RD)
+#   define SHUTDOWN_W(A)             ::shutdown((A),SHUT_WR)
+
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <limits.h>
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+//#line 1 "route66.hpp"
+// lightweight http server
+// - rlyeh, zlib/libpng licensed. based on code by Ivan Tikhonov (zlib licensed)
+
+/**/// <-- remove an asterisk in a code editor to highlight API
+
+//#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <sstream>
+
+// taken from https://github.com/r-lyeh/bridge {
+#if (__cplusplus < 201103L && !defined(_MSC_VER)) || (defined(_MSC_VER) && (_MSC_VER < 1700)) || (defined(__GLIBCXX__) && __GLIBCXX__ < 20130322L)
+#   include <boost/functional.hpp> // if old libstdc++ or msc libs are found, use boost::function
+#   include <boost/function.hpp>   //
+#   include <boost/thread.hpp>     // and boost::thread
+namespace std {
+	namespace placeholders {
+		//...
+	}
+	using namespace boost;
+}
+#else
+#   include <functional>       // else assume modern c++11 and use std::function<> instead
+#   include <mutex>            // and std::mutex
+#   include <thread>           // and std::thread
+#endif
+// }
+
+namespace route66 {
+
+	/*/ request:: 'class'
+	/*/
+	struct request {
+		std::string data;                              /*/      .data 'raw received data, as is' /*/
+		std::string method;                            /*/    .method 'raw method ("GET HEAD POST PUT ...")' /*/
+		std::string url;                               /*/       .url 'raw request ("/search?req1=blabla&req2=what%20ever")' /*/
+		std::string uri;                               /*/      .path 'decoded path uri ("/search")' /*/
+		std::string options;                           /*/   .options 'raw GET/POST options url ("req1=blabla&req2=what%20ever")' /*/
+		std::map<std::string, std::string> arguments;  /*/ .arguments 'decoded options decoupled as arguments ( {"req1","blabla"}, {"req2","what ever"} )' /*/
 		std::map<std::string, std::string> multipart;  /*/ .multipart 'multipart files when POST' /*/
 		std::string ip;                                /*/        .ip 'ip address of request' /*/
 		   unsigned port;                              /*/      .port 'number port of request' /*/
@@ -2365,865 +3621,2011 @@ namespace route66 {
 			for( cit it = arguments.begin(), end = arguments.end(); it != end; ++it ) {
 				ss << "\t" "argument[" << it->first << "]: " << it->second << std::endl;
 			}
-			for( cit it = multipart.begin(), end = multipart.end(); it != end; ++it ) {
-				ss << "\t" "multipart[" << it->first << "]: " << it->second << std::endl;
+			for( cit it = multipart.begin(), end = multipart.end(); it != end; ++it ) {
+				ss << "\t" "multipart[" << it->first << "]: " << it->second << std::endl;
+			}
+			ss << "\t" "data: " << data << std::endl;
+			ss << "}; //route66::request [" << this << "]" << std::endl;
+			return ss.str();
+		}
+	};
+
+	/*/ callback; 'alias'
+	/*/ typedef std::function< int(request &,std::ostream &,std::ostream &) > callback;
+
+	/*/ create() 'start a daemon at given port and route mask, callback will be invoked; returns false if failed.'
+	/*/ bool create( unsigned port, const std::string &mask, const route66::callback &callback );
+
+	/*/ fserve() 'start a file server daemon at given port and relative path, all file uri contents will be returned; returns false if failed.'
+	/*/ bool fserve( unsigned port, const std::string &mask, const std::string &relpath );
+
+	/*/ httpcode:: 'listing of HTTP result codes'
+	/*/
+	struct httpcode {
+		unsigned code;
+		const char *const description;
+	};
+
+	/*/ 0XX 'route66'
+	/*/
+	extern const httpcode SHUTDOWN;
+	/*/ 1XX 'informational'
+	/*/
+	extern const httpcode CONTINUE;
+	extern const httpcode SWITCH_PROTOCOLS;
+	/*/ 2XX 'success'
+	/*/
+	extern const httpcode OK;
+	extern const httpcode CREATED;
+	extern const httpcode ACCEPTED;
+	extern const httpcode PARTIAL;
+	extern const httpcode NO_CONTENT;
+	extern const httpcode RESET_CONTENT;
+	extern const httpcode PARTIAL_CONTENT;
+	extern const httpcode WEBDAV_MULTI_STATUS;
+	/*/ 3XX 'redirection'
+	/*/
+	extern const httpcode AMBIGUOUS;
+	extern const httpcode MOVED;
+	extern const httpcode REDIRECT;
+	extern const httpcode REDIRECT_METHOD;
+	extern const httpcode NOT_MODIFIED;
+	extern const httpcode USE_PROXY;
+	extern const httpcode REDIRECT_KEEP_VERB;
+	/*/ 4XX 'client error'
+	/*/
+	extern const httpcode BAD_REQUEST;
+	extern const httpcode DENIED;
+	extern const httpcode PAYMENT_REQ;
+	extern const httpcode FORBIDDEN;
+	extern const httpcode NOT_FOUND;
+	extern const httpcode BAD_METHOD;
+	extern const httpcode NONE_ACCEPTABLE;
+	extern const httpcode PROXY_AUTH_REQ;
+	extern const httpcode REQUEST_TIMEOUT;
+	extern const httpcode CONFLICT;
+	extern const httpcode GONE;
+	extern const httpcode LENGTH_REQUIRED;
+	extern const httpcode PRECOND_FAILED;
+	extern const httpcode REQUEST_TOO_LARGE;
+	extern const httpcode URI_TOO_LONG;
+	extern const httpcode UNSUPPORTED_MEDIA;
+	extern const httpcode RETRY_WITH;
+	/*/ 5XX 'server error'
+	/*/
+	extern const httpcode SERVER_ERROR;
+	extern const httpcode NOT_SUPPORTED;
+	extern const httpcode BAD_GATEWAY;
+	extern const httpcode SERVICE_UNAVAIL;
+	extern const httpcode GATEWAY_TIMEOUT;
+	extern const httpcode VERSION_NOT_SUP;
+
+	/*/ mime() 'MIME string header based on file extension (ie, sample.json -> "Content-Type: application/json; charset=utf-8\r\n" )' /*/
+	/*/ tag()  'MIME string tag based on file extension (ie, sample.json -> "application/json" )' /*/
+	std::string mime( const std::string &filename_ext );
+	std::string tag( const std::string &filename_ext );
+}
+
+namespace {
+	// http://stackoverflow.com/questions/2673207/c-c-url-decode-library
+	char * urldecode2(char *dst, const char *src) {
+		char a, b;
+		while (*src) {
+			if ((*src == '%') &&
+				((a = src[1]) && (b = src[2])) &&
+				(isxdigit(a) && isxdigit(b))) {
+					if (a >= 'a')
+							a -= 'a'-'A';
+					if (a >= 'A')
+							a -= ('A' - 10);
+					else
+							a -= '0';
+					if (b >= 'a')
+							b -= 'a'-'A';
+					if (b >= 'A')
+							b -= ('A' - 10);
+					else
+							b -= '0';
+					*dst++ = 16*a+b;
+					src+=3;
+			} else {
+				*dst++ = *src++;
+			}
+		}
+		*dst++ = '\0';
+		return dst - 1;
+	}
+
+	std::string &urldecode2( std::string &url ) {
+		char *begin = &url[0], *end = urldecode2( begin, begin );
+		url.resize( end - begin );
+		return url;
+	}
+
+	// taken from https://github.com/r-lyeh/wire
+	std::string replace( std::string s, const std::string &target, const std::string &repl ) {
+		for( size_t it = 0, tlen = target.length(), rlen = repl.length(); ( it = s.find( target, it ) ) != std::string::npos; it += rlen ) {
+			s.replace( it, tlen, repl );
+		}
+		return s;
+	};
+	std::vector< std::string > tokenize( const std::string &self, const std::string &delimiters ) {
+		std::string map( 256, '\0' );
+		for( std::string::const_iterator it = delimiters.begin(), end = delimiters.end(); it != end; ++it ) {
+			unsigned char ch( *it );
+			map[ ch ] = '\1';
+		}
+		std::vector< std::string > tokens(1);
+		for( std::string::const_iterator it = self.begin(), end = self.end(); it != end; ++it ) {
+			unsigned char ch( *it );
+			/**/ if( !map.at(ch)          ) tokens.back().push_back( char(ch) );
+			else if( tokens.back().size() ) tokens.push_back( std::string() );
+		}
+		while( tokens.size() && !tokens.back().size() ) tokens.pop_back();
+		return tokens;
+	}
+	bool match( const char *pattern, const char *str ) {
+		if( *pattern=='\0' ) return !*str;
+		if( *pattern=='*' )  return match(pattern+1, str) || (*str && match(pattern, str+1));
+		if( *pattern=='?' )  return *str && (*str != '.') && match(pattern+1, str+1);
+		return (*str == *pattern) && match(pattern+1, str+1);
+	}
+	bool matches( const std::string &self, const std::string &pattern ) {
+		return match( pattern.c_str(), self.c_str() );
+	}
+	bool endswith( const std::string &self, const std::string &eof ) {
+		return eof.size() < self.size() && self.substr( self.size() - eof.size() ) == eof;
+	}
+}
+
+namespace route66 {
+
+std::string tag( const std::string &pathfile ) {
+	static std::map< std::string, std::string> mimes;
+	if( mimes.empty() ) {
+		// [ref] taken from http://en.wikipedia.org/wiki/Internet_media_type
+
+		mimes[".avi"] = "video/avi";                  // Covers most Windows-compatible formats including .avi and .divx[16]
+		mimes[".mpg"] = "video/mpeg";                 // MPEG-1 video with multiplexed audio; Defined in RFC 2045 and RFC 2046
+		mimes[".mpeg"] = "video/mpeg";                // MPEG-1 video with multiplexed audio; Defined in RFC 2045 and RFC 2046
+		mimes[".mp4"] = "video/mp4";                  // MP4 video; Defined in RFC 4337
+		mimes[".mov"] = "video/quicktime";            // QuickTime video; Registered[17]
+		mimes[".webm"] = "video/webm";                // WebM Matroska-based open media format
+		mimes[".mkv"] = "video/x-matroska";           // Matroska open media format
+		mimes[".wmv"] = "video/x-ms-wmv";             // Windows Media Video; Documented in Microsoft KB 288102
+		mimes[".flv"] = "video/x-flv";                // Flash video (FLV files)
+
+		mimes[".css"] = "text/css";                   // Cascading Style Sheets; Defined in RFC 2318
+		mimes[".csv"] = "text/csv";                   // Comma-separated values; Defined in RFC 4180
+		mimes[".htm"] = "text/html";                  // HTML; Defined in RFC 2854
+		mimes[".html"] = "text/html";                 // HTML; Defined in RFC 2854
+		mimes[".txt"] = "text/plain";                 // Textual data; Defined in RFC 2046 and RFC 3676
+		mimes[".text"] = "text/plain";                // Textual data; Defined in RFC 2046 and RFC 3676
+		mimes[".rtf"] = "text/rtf";                   // RTF; Defined by Paul Lindner
+		mimes[".xml"] = "text/xml";                   // Extensible Markup Language; Defined in RFC 3023
+		mimes[".tsv"] = "text/tab-separated-values";
+
+		mimes[".gif"] = "image/gif";                  // GIF image; Defined in RFC 2045 and RFC 2046
+		mimes[".jpg"] = "image/jpeg";                 // JPEG JFIF image; Defined in RFC 2045 and RFC 2046
+		mimes[".jpeg"] = "image/jpeg";                // JPEG JFIF image; Defined in RFC 2045 and RFC 2046
+		mimes[".pjpg"] = "image/pjpeg";               // JPEG JFIF image; Associated with Internet Explorer; Listed in ms775147(v=vs.85) - Progressive JPEG, initiated before global browser support for progressive JPEGs (Microsoft and Firefox).
+		mimes[".pjpeg"] = "image/pjpeg";              // JPEG JFIF image; Associated with Internet Explorer; Listed in ms775147(v=vs.85) - Progressive JPEG, initiated before global browser support for progressive JPEGs (Microsoft and Firefox).
+		mimes[".png"] = "image/png";                  // Portable Network Graphics; Registered,[13] Defined in RFC 2083
+		mimes[".svg"] = "image/svg+xml";              // SVG vector image; Defined in SVG Tiny 1.2 Specification Appendix M
+		mimes[".psd"] = "image/vnd.adobe.photoshop";
+
+		mimes[".aif"] = "audio/x-aiff";
+		mimes[".s3m"] = "audio/s3m";
+		mimes[".xm"] = "audio/xm";
+		mimes[".snd"] = "audio/x-adpcm";
+		mimes[".mp3"] = "audio/mpeg3";
+		mimes[".ogg"] = "audio/ogg";                  // Ogg Vorbis, Speex, Flac and other audio; Defined in RFC 5334
+		mimes[".opus"] = "audio/opus";                // Opus audio
+		mimes[".vorbis"] = "audio/vorbis";            // Vorbis encoded audio; Defined in RFC 5215
+		mimes[".wav"] = "audio/x-wav";
+
+		mimes[".atom"] = "application/atom+xml";      // Atom feeds
+		mimes[".dart"] = "application/dart";          // Dart files [8]
+		mimes[".ejs"] = "application/ecmascript";     // ECMAScript/JavaScript; Defined in RFC 4329 (equivalent to application/javascript but with stricter processing rules)
+		mimes[".json"] = "application/json";          // JavaScript Object Notation JSON; Defined in RFC 4627
+		mimes[".js"] = "application/javascript";      // ECMAScript/JavaScript; Defined in RFC 4329 (equivalent to application/ecmascript but with looser processing rules) It is not accepted in IE 8 or earlier - text/javascript is accepted but it is defined as obsolete in RFC 4329. The "type" attribute of the <script> tag in HTML5 is optional. In practice, omitting the media type of JavaScript programs is the most interoperable solution, since all browsers have always assumed the correct default even before HTML5.
+		mimes[".bin"] = "application/octet-stream";   // Arbitrary binary data.[9] Generally speaking this type identifies files that are not associated with a specific application. Contrary to past assumptions by software packages such as Apache this is not a type that should be applied to unknown files. In such a case, a server or application should not indicate a content type, as it may be incorrect, but rather, should omit the type in order to allow the recipient to guess the type.[10]
+		mimes[".pdf"] = "application/pdf";            // Portable Document Format, PDF has been in use for document exchange on the Internet since 1993; Defined in RFC 3778
+		mimes[".ps"] = "application/postscript";      // PostScript; Defined in RFC 2046
+		mimes[".rdf"] = "application/rdf+xml";        // Resource Description Framework; Defined by RFC 3870
+		mimes[".rss"] = "application/rss+xml";        // RSS feeds
+		mimes[".soap"] = "application/soap+xml";      // SOAP; Defined by RFC 3902
+		mimes[".font"] = "application/font-woff";     // Web Open Font Format; (candidate recommendation; use application/x-font-woff until standard is official)
+		mimes[".xhtml"] = "application/xhtml+xml";    // XHTML; Defined by RFC 3236
+		mimes[".xml"] = "application/xml";            // XML files; Defined by RFC 3023
+		mimes[".zip"] = "application/zip";            // ZIP archive files; Registered[11]
+		mimes[".gz"] = "application/gzip";            // Gzip, Defined in RFC 6713
+		mimes[".nacl"] = "application/x-nacl";        // Native Client web module (supplied via Google Web Store only)
+		mimes[".pnacl"] = "application/x-pnacl";      // Portable Native Client web module (may supplied by any website as it is safer than x-nacl)
+	};
+
+	size_t ext = pathfile.find_last_of(".");
+	if( ext != std::string::npos ) {
+		std::map<std::string, std::string>::const_iterator found = mimes.find( &pathfile[ext] );
+		if( found != mimes.end() ) {
+			return found->second;
+		}
+	}
+	return mimes[".txt"];
+}
+
+std::string mime( const std::string &filename_ext ) {
+	return std::string("Content-Type: ") + tag(filename_ext) + "; charset=utf-8\r\n";
+};
+
+std::string interval_from_headers( const std::string &header, const std::string &text1, const std::string &text2 ) {
+	size_t pos = header.find(text1);
+	if( pos == std::string::npos ) {
+		return std::string();
+	}
+	pos += text1.size();
+	size_t pos2 = header.find(text2, pos);
+	if( pos2 == std::string::npos ) {
+		return header.substr(pos);
+	} else {
+		return header.substr(pos, pos2-pos);
+	}
+}
+
+std::string extract_from_headers( const std::string &header, const std::string &text ) {
+	size_t pos = header.find(text);
+	if( pos == std::string::npos ) {
+		return std::string();
+	}
+	pos += text.size();
+	size_t pos2 = header.find( "\r\n", pos );
+	if( pos2 == std::string::npos ) {
+		return header.substr(pos);
+	} else {
+		return header.substr(pos, pos2-pos);
+	}
+}
+
+struct daemon {
+	int socket;
+	const std::map< std::string /*path*/, route66::callback /*fn*/ > *routers;
+	std::string base;
+
+	daemon() : socket(-1), routers(0)
+	{}
+
+	void operator()() {
+		bool shutdown = false;
+		while( !shutdown ) {
+			enum { buflen = 1024 * 1024, SPACES = 2 /*>=2*/ };
+
+			int child = ACCEPT(socket,0,0), o = 0, h[SPACES] = {}, hi = 0;
+			if( child < 0 ) continue;
+
+			std::string buf( buflen, '\0' );
+			char *b = &buf[0];
+
+			while(hi<SPACES&&o<buflen) {
+				int n = READ(child,b+o,buflen-o);
+				if(n<=0) { break; }
+				else {
+					int i = o;
+					o+=n;
+					for(;i<n&&hi<SPACES;i++) {
+					if((hi < SPACES) && b[i] == ' ') { h[hi++] = i; }
+					}
+				}
+			}
+
+			if(hi >= SPACES) {
+				b[ o ] = '\0';
+				buf.resize( o );
+
+				const char *logmask = std::getenv("R66LOG");
+				if( logmask ) {
+					if( matches(b, logmask) ) {
+						//__asm int 3;
+						//fprintf(stdout, "%s,%s\n", multipart.c_str(), boundary.c_str());
+					}
+				}
+
+				typedef std::map< std::string, std::string > filemap;
+				static std::map< std::string /*boundary*/, filemap > boundaries;
+
+				unsigned curlen = 0;
+
+				std::string boundary = std::string("--") + extract_from_headers( buf, "Content-Type: multipart/form-data; boundary=");
+				std::string eof = boundary + "--\r\n";
+				std::string headers = buf.substr( 0, buf.find("\r\n\r\n") + 4 );
+				std::string payload = buf.substr( headers.size() );
+
+				while( boundary.size() > 2 && !endswith( payload, eof ) ) {
+					std::stringstream head1, head2;
+					head1 << "HTTP/1.1 100 Continue\r\n";
+					WRITE( child, head1.str().c_str(), head1.str().size() );
+
+					o = 0;
+					buf.clear();
+					buf.resize( buflen, '\0' );
+
+					int n;
+					n = READ(child,b+o,buflen-o);
+					if(n<=0) { break; }
+
+					buf.resize( n );
+
+					payload += buf;
+				}
+
+				route66::request rq;
+
+				if( boundary.size() > 2 ) {
+					payload = interval_from_headers( payload, boundary + "\r\n", boundary );
+
+					{
+						std::string headers = payload.substr( 0, payload.find("\r\n\r\n") + 4 );
+						std::string file = extract_from_headers( headers, "Content-Disposition: form-data; name=");
+						file = file.substr( 1, file.size() - 2 ); // remove ""
+
+						payload = payload.substr( headers.size() );
+						rq.multipart[ file ] = payload;
+					}
+
+					buf = headers;
+				}
+
+				rq.data = buf;
+
+				char org = b[h[1]];
+				b[h[1]] = '\0';
+
+#if 1
+				socklen_t len;
+				struct sockaddr_storage addr;
+				char ipstr[INET_ADDRSTRLEN];
+				len = sizeof addr;
+				getpeername(child, (struct sockaddr*) &addr, &len);
+				struct sockaddr_in *s = (struct sockaddr_in *) &addr;
+				inet_ntop(AF_INET, &s->sin_addr, ipstr, sizeof ipstr);
+				if( std::strcmp("127.0.0.1", ipstr) == 0 ) rq.ip = "localhost";
+				else rq.ip = ipstr;
+
+				struct sockaddr_in l;
+				len = sizeof(l);
+				if (getsockname(child, (struct sockaddr *)&l, &len) != -1) {
+					rq.port = ntohs(l.sin_port);
+				} else {
+					rq.port = 0;
+				}
+#endif
+
+				std::string method( b, h[0] );
+				std::string url( &b[h[0]+1] ); //skip "GET "
+				b[h[1]] = org;
+
+				std::string path, options;
+
+				size_t mark = url.find_first_of('?');
+				if( mark == std::string::npos ) {
+					path = url;
+				} else {
+					path = url.substr( 0, mark );
+					options = url.substr( mark + 1 );
+				}
+
+				if( method == "PUT" || method == "POST" )  {
+					options = &b[ std::string(b).find("\r\n\r\n") + 4 ];
+				}
+
+				std::string route = method + " " + path;
+				std::map< std::string, route66::callback >::const_iterator found = routers->find( route );
+				if( found == routers->end() ) {
+					// bad route, try index wildcard matching
+					for( found = routers->begin(); found != routers->end(); ++found ) {
+						if( matches( route, found->first ) ) {
+							break;
+						}
+					}
+				}
+				if( found == routers->end() ) {
+					// bad route, try index fallback
+					found = routers->find("GET /");
+				}
+
+				if( found != routers->end() ) {
+
+					rq.method = method;
+					rq.url = url;
+					rq.uri = path;
+					rq.options = options;
+
+					urldecode2( rq.uri );
+
+					// arguments
+					std::vector< std::string > split = tokenize( options, "&" );
+					for( std::vector< std::string >::const_iterator it = split.begin(), end = split.end(); it != end; ++it ) {
+						const std::string &glued = *it;
+						std::vector< std::string > pair = tokenize( glued, "=" );
+						if( 2 == pair.size() ) {
+							rq.arguments[ urldecode2(pair[0]) ] = urldecode2(pair[1]);
+						} else {
+							rq.arguments[ urldecode2(pair[0]) ] = std::string();
+						}
+					}
+
+					// normalize & rebase (if needed)
+					if( rq.uri == "" || rq.uri == "/" ) rq.uri = "index.html";
+					rq.uri = base + rq.uri;
+
+					if( logmask ) {
+						char addr[64]; sprintf(addr, "%s:%d", rq.ip.c_str(), rq.port );
+						if( matches(addr, logmask) || matches(rq.uri, logmask) || matches(rq.data, logmask) ) {
+							fprintf(stdout, "%s - %s\n%s\n", addr, rq.uri.c_str(), rq.str().c_str());
+						}
+					}
+
+					{
+						const route66::callback &fn = found->second;
+						std::stringstream headers, contents;
+						int httpcode = fn( rq, headers, contents );
+
+						std::string datas = contents.str();
+						shutdown = ( 0 == httpcode ? true : false );
+
+						if( !shutdown && datas.size() ) {
+							std::stringstream head1, head2;
+							head1 << "HTTP/1.1 " << httpcode << " OK\r\n";
+							head2 << headers.str() << "Content-Length: " << datas.size() << "\r\n\r\n";
+
+							WRITE( child, head1.str().c_str(), head1.str().size() );
+							WRITE( child, head2.str().c_str(), head2.str().size() );
+							if( method != "HEAD" )
+							WRITE( child, datas.c_str(), datas.size() );
+						}
+					}
+
+				}
+
+				SHUTDOWN(child);
+				CLOSE(child);
+			}
+		}
+	}
+};
+
+namespace {
+
+	typedef std::map< std::string /*path*/, route66::callback /*fn */> routers;
+
+	bool create( unsigned port, const std::string &mask, const route66::callback &fn, std::string base ) {
+		static std::map< unsigned, routers > daemons;
+
+		if( daemons.find(port) == daemons.end() ) {
+			INIT();
+			int socket = SOCKET(PF_INET, SOCK_STREAM, IPPROTO_IP);
+			if( socket < 0 ) {
+				return "cannot init socket", false;
 			}
-			ss << "\t" "data: " << data << std::endl;
-			ss << "}; //route66::request [" << this << "]" << std::endl;
-			return ss.str();
+
+			struct sockaddr_in l;
+			std::memset( &l, 0, sizeof(sockaddr_in) );
+			l.sin_family = AF_INET;
+			l.sin_port = htons(port);
+			l.sin_addr.s_addr = INADDR_ANY;
+	#       if !defined(_WIN32)
+			int r = 1; setsockopt(socket,SOL_SOCKET,SO_REUSEADDR,&r,sizeof(r));
+	#       endif
+			BIND(socket,(struct sockaddr *)&l,sizeof(l));
+			LISTEN(socket,5);
+
+			route66::daemon dm;
+			dm.socket = socket;
+			dm.routers = &daemons[ port ];
+			dm.base = base;
+			std::thread( dm ).detach();
 		}
-	};
 
-	/*/ callback; 'alias'
-	/*/ typedef std::function< int(request &,std::ostream &,std::ostream &) > callback;
+		daemons[ port ][ mask ] = fn;
 
-	/*/ create() 'start a daemon at given port and route mask, callback will be invoked; returns false if failed.'
-	/*/ bool create( unsigned port, const std::string &mask, const route66::callback &callback );
+		return "ok", true;
+	}
+}
 
-	/*/ fserve() 'start a file server daemon at given port and relative path, all file uri contents will be returned; returns false if failed.'
-	/*/ bool fserve( unsigned port, const std::string &mask, const std::string &relpath );
+bool create( unsigned port, const std::string &mask, const route66::callback &fn ) {
+	return create( port, mask, fn, std::string() );
+}
 
-	/*/ httpcode:: 'listing of HTTP result codes'
-	/*/
-	struct httpcode {
-		unsigned code;
-		const char *const description;
-	};
+namespace {
 
-	/*/ 0XX 'route66'
-	/*/
-	extern const httpcode SHUTDOWN;
-	/*/ 1XX 'informational'
-	/*/
-	extern const httpcode CONTINUE;
-	extern const httpcode SWITCH_PROTOCOLS;
-	/*/ 2XX 'success'
-	/*/
-	extern const httpcode OK;
-	extern const httpcode CREATED;
-	extern const httpcode ACCEPTED;
-	extern const httpcode PARTIAL;
-	extern const httpcode NO_CONTENT;
-	extern const httpcode RESET_CONTENT;
-	extern const httpcode PARTIAL_CONTENT;
-	extern const httpcode WEBDAV_MULTI_STATUS;
-	/*/ 3XX 'redirection'
-	/*/
-	extern const httpcode AMBIGUOUS;
-	extern const httpcode MOVED;
-	extern const httpcode REDIRECT;
-	extern const httpcode REDIRECT_METHOD;
-	extern const httpcode NOT_MODIFIED;
-	extern const httpcode USE_PROXY;
-	extern const httpcode REDIRECT_KEEP_VERB;
-	/*/ 4XX 'client error'
-	/*/
-	extern const httpcode BAD_REQUEST;
-	extern const httpcode DENIED;
-	extern const httpcode PAYMENT_REQ;
-	extern const httpcode FORBIDDEN;
-	extern const httpcode NOT_FOUND;
-	extern const httpcode BAD_METHOD;
-	extern const httpcode NONE_ACCEPTABLE;
-	extern const httpcode PROXY_AUTH_REQ;
-	extern const httpcode REQUEST_TIMEOUT;
-	extern const httpcode CONFLICT;
-	extern const httpcode GONE;
-	extern const httpcode LENGTH_REQUIRED;
-	extern const httpcode PRECOND_FAILED;
-	extern const httpcode REQUEST_TOO_LARGE;
-	extern const httpcode URI_TOO_LONG;
-	extern const httpcode UNSUPPORTED_MEDIA;
-	extern const httpcode RETRY_WITH;
-	/*/ 5XX 'server error'
-	/*/
-	extern const httpcode SERVER_ERROR;
-	extern const httpcode NOT_SUPPORTED;
-	extern const httpcode BAD_GATEWAY;
-	extern const httpcode SERVICE_UNAVAIL;
-	extern const httpcode GATEWAY_TIMEOUT;
-	extern const httpcode VERSION_NOT_SUP;
+	std::string get_app_folder() {
+#       ifdef _WIN32
+			char s_path[MAX_PATH] = {0};
+			const size_t len = MAX_PATH;
+
+			HMODULE mod = 0;
+			::GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCSTR)&get_app_folder, &mod);
+			DWORD size = ::GetModuleFileNameA(mod, s_path, (DWORD)len);
+
+			while( size > 0 ) {
+				if( s_path[size] == '\\' ) {
+					s_path[size+1] = '\0';
+					return s_path;
+				}
+				--size;
+			}
+			return std::string();
+#       else
+			char arg1[20];
+			char exepath[PATH_MAX + 1] = {0};
+
+			sprintf( arg1, "/proc/%d/exe", getpid() );
+			readlink( arg1, exepath, 1024 );
+			return std::string( exepath );
+#       endif
+	}
+
+	int file_reader( route66::request &request, std::ostream &headers, std::ostream &contents ) {
+		std::ifstream ifs( request.uri.c_str(), std::ios::binary );
+		if( ifs.good() ) {
+			headers << route66::mime(request.uri);
+			contents << ifs.rdbuf();
+			return 200;
+		} else {
+			headers << route66::mime(".text");
+			contents << "404: not found" << std::endl;
+			//contents << request.uri << std::endl;
+			return 404;
+		}
+	}
+}
+
+bool fserve( unsigned port, const std::string &mask, const std::string &path ) {
+	return create( port, mask, file_reader, get_app_folder() + path );
+}
+
+#undef INIT
+#undef SOCKET
+#undef ACCEPT
+#undef CONNECT
+#undef CLOSE
+#undef RECV
+#undef READ
+#undef SELECT
+#undef SEND
+#undef WRITE
+#undef GETSOCKOPT
+#undef SETSOCKOPT
+
+#undef BIND
+#undef LISTEN
+#undef SHUTDOWN
+#undef SHUTDOWN_R
+#undef SHUTDOWN_W
+
+/*/ 1XX informational
+/*/ const httpcode SHUTDOWN = { 0, "Shutdown requested" };
+/*/ 1XX informational
+/*/ const httpcode CONTINUE = { 100, "The request can be continued." }; /*/
+/*/ const httpcode SWITCH_PROTOCOLS = { 101, "The server has switched protocols in an upgrade header." };
+/*/ 2XX success
+/*/ const httpcode OK = { 200, "The request completed successfully." }; /*/
+/*/ const httpcode CREATED = { 201, "The request has been fulfilled and resulted in the creation of a new resource." }; /*/
+/*/ const httpcode ACCEPTED = { 202, "The request has been accepted for processing, but the processing has not been completed." }; /*/
+/*/ const httpcode PARTIAL = { 203, "The returned meta information in the entity-header is not the definitive set available from the originating server." }; /*/
+/*/ const httpcode NO_CONTENT = { 204, "The server has fulfilled the request, but there is no new information to send back." }; /*/
+/*/ const httpcode RESET_CONTENT = { 205, "The request has been completed, and the client program should reset the document view that caused the request to be sent to allow the user to easily initiate another input action." }; /*/
+/*/ const httpcode PARTIAL_CONTENT = { 206, "The server has fulfilled the partial GET request for the resource." }; /*/
+/*/ const httpcode WEBDAV_MULTI_STATUS = { 207, "During a World Wide Web Distributed Authoring and Versioning (WebDAV) operation, this indicates multiple status const httpcodes for a single response. The response body contains Extensible Markup Language (XML) that describes the status const httpcodes. For more information, see HTTP Extensions for Distributed Authoring." };
+/*/ 3XX redirection
+/*/ const httpcode AMBIGUOUS = { 300, "The requested resource is available at one or more locations." }; /*/
+/*/ const httpcode MOVED = { 301, "The requested resource has been assigned to a new permanent Uniform Resource Identifier (URI), and any future references to this resource should be done using one of the returned URIs." }; /*/
+/*/ const httpcode REDIRECT = { 302, "The requested resource resides temporarily under a different URI." }; /*/
+/*/ const httpcode REDIRECT_METHOD = { 303, "The response to the request can be found under a different URI and should be retrieved using a GET HTTP verb on that resource." }; /*/
+/*/ const httpcode NOT_MODIFIED = { 304, "The requested resource has not been modified." }; /*/
+/*/ const httpcode USE_PROXY = { 305, "The requested resource must be accessed through the proxy given by the location field." }; /*/
+/*/ const httpcode REDIRECT_KEEP_VERB = { 307, "The redirected request keeps the same HTTP verb. HTTP/1.1 behavior." };
+/*/ 4XX client's fault
+/*/ const httpcode BAD_REQUEST = { 400, "The request could not be processed by the server due to invalid syntax." }; /*/
+/*/ const httpcode DENIED = { 401, "The requested resource requires user authentication." }; /*/
+/*/ const httpcode PAYMENT_REQ = { 402, "Not implemented in the HTTP protocol." }; /*/
+/*/ const httpcode FORBIDDEN = { 403, "The server understood the request, but cannot fulfill it." }; /*/
+/*/ const httpcode NOT_FOUND = { 404, "The server has not found anything that matches the requested URI." }; /*/
+/*/ const httpcode BAD_METHOD = { 405, "The HTTP verb used is not allowed." }; /*/
+/*/ const httpcode NONE_ACCEPTABLE = { 406, "No responses acceptable to the client were found." }; /*/
+/*/ const httpcode PROXY_AUTH_REQ = { 407, "Proxy authentication required." }; /*/
+/*/ const httpcode REQUEST_TIMEOUT = { 408, "The server timed out waiting for the request." }; /*/
+/*/ const httpcode CONFLICT = { 409, "The request could not be completed due to a conflict with the current state of the resource. The user should resubmit with more information." }; /*/
+/*/ const httpcode GONE = { 410, "The requested resource is no longer available at the server, and no forwarding address is known." }; /*/
+/*/ const httpcode LENGTH_REQUIRED = { 411, "The server cannot accept the request without a defined content length." }; /*/
+/*/ const httpcode PRECOND_FAILED = { 412, "The precondition given in one or more of the request header fields evaluated to false when it was tested on the server." }; /*/
+/*/ const httpcode REQUEST_TOO_LARGE = { 413, "The server cannot process the request because the request entity is larger than the server is able to process." }; /*/
+/*/ const httpcode URI_TOO_LONG = { 414, "The server cannot service the request because the request URI is longer than the server can interpret." }; /*/
+/*/ const httpcode UNSUPPORTED_MEDIA = { 415, "The server cannot service the request because the entity of the request is in a format not supported by the requested resource for the requested method." }; /*/
+/*/ const httpcode RETRY_WITH = { 449, "The request should be retried after doing the appropriate action." };
+/*/ 5XX server's fault
+/*/ const httpcode SERVER_ERROR = { 500, "The server encountered an unexpected condition that prevented it from fulfilling the request." }; /*/
+/*/ const httpcode NOT_SUPPORTED = { 501, "The server does not support the functionality required to fulfill the request." }; /*/
+/*/ const httpcode BAD_GATEWAY = { 502, "The server, while acting as a gateway or proxy, received an invalid response from the upstream server it accessed in attempting to fulfill the request." }; /*/
+/*/ const httpcode SERVICE_UNAVAIL = { 503, "The service is temporarily overloaded." }; /*/
+/*/ const httpcode GATEWAY_TIMEOUT = { 504, "The request was timed out waiting for a gateway." }; /*/
+/*/ const httpcode VERSION_NOT_SUP = { 505, "The server does not support the HTTP protocol version that was used in the request message." };
 
-	/*/ mime() 'MIME string header based on file extension (ie, sample.json -> "Content-Type: application/json; charset=utf-8\r\n" )' /*/
-	/*/ tag()  'MIME string tag based on file extension (ie, sample.json -> "application/json" )' /*/
-	std::string mime( const std::string &filename_ext );
-	std::string tag( const std::string &filename_ext );
 }
 
-namespace {
-	// http://stackoverflow.com/questions/2673207/c-c-url-decode-library
-	char * urldecode2(char *dst, const char *src) {
-		char a, b;
-		while (*src) {
-			if ((*src == '%') &&
-				((a = src[1]) && (b = src[2])) &&
-				(isxdigit(a) && isxdigit(b))) {
-					if (a >= 'a')
-							a -= 'a'-'A';
-					if (a >= 'A')
-							a -= ('A' - 10);
-					else
-							a -= '0';
-					if (b >= 'a')
-							b -= 'a'-'A';
-					if (b >= 'A')
-							b -= ('A' - 10);
-					else
-							b -= '0';
-					*dst++ = 16*a+b;
-					src+=3;
-			} else {
-				*dst++ = *src++;
-			}
-		}
-		*dst++ = '\0';
-		return dst - 1;
-	}
 
-	std::string &urldecode2( std::string &url ) {
-		char *begin = &url[0], *end = urldecode2( begin, begin );
-		url.resize( end - begin );
-		return url;
+#endif
+
+// checks: todo
+// if /MD or /MDd and kTraceyReportWildPointers warn user "not a good idea"
+#if kTraceyHookLegacyCRT
+	$warning( "<tracey/tracey.cpp> says: kTraceyHookLegacyCRT option ignored. CRT hooking not supported on this platform.")
+#   undef  kTraceyHookLegacyCRT
+#   define kTraceyHookLegacyCRT 0
+#endif
+#if kTraceyAsyncTracking && !$on($cpp11)
+	$warning( "<tracey/tracey.cpp> says: kTraceyAsyncTracking option ignored. Async tracking requires C++11.")
+#   undef  kTraceyAsyncTracking
+#   define kTraceyAsyncTracking 0
+#endif
+#if kTraceySpinlocks && !$on($cpp11)
+	$warning( "<tracey/tracey.cpp> says: kTraceySpinlocks option ignored. Spinlocks require C++11.")
+#   undef  kTraceySpinlocks
+#   define kTraceySpinlocks 0
+#endif
+#if kTraceyForkReports && defined(_WIN32)
+	$warning( "<tracey/tracey.cpp> says: kTraceyForkReports option ignored. Forked reports require fork().")
+#   undef  kTraceyForkReports
+#   define kTraceyForkReports 0
+#endif
+#if kTraceyInbandHeaders && !kTraceyDefineMemoryOperators
+	$warning( "<tracey/tracey.cpp> says: kTraceyInbandHeaders option ignored. In-band headers require kTraceyDefineMemoryOperators.")
+#   undef  kTraceyInbandHeaders
+#   define kTraceyInbandHeaders 0
+#endif
+
+// tracey bookkeeping lives in memory mapped straight from the OS (see arena below)
+#ifndef _WIN32
+#   include <sys/mman.h>
+#endif
+
+namespace tracey
+{
+	static void webmain( void * );
+	static void hotkeymain( void * );
+	static void controlmain( void * );
+
+	typedef heal::sfstring string;
+	typedef heal::sfstrings strings;
+
+	std::string human( size_t bytes ) {
+		/**/ if( bytes >= 1024 * 1024 * 1024 ) return tracey::string("\1 GB", bytes / (1024 * 1024 * 1024));
+		else if( bytes >=   16 * 1024 * 1024 ) return tracey::string("\1 MB", bytes / (       1024 * 1024));
+		else if( bytes >=          16 * 1024 ) return tracey::string("\1 KB", bytes / (              1024));
+		else                                   return tracey::string("\1 bytes", bytes );
 	}
 
-	// taken from https://github.com/r-lyeh/wire
-	std::string replace( std::string s, const std::string &target, const std::string &repl ) {
-		for( size_t it = 0, tlen = target.length(), rlen = repl.length(); ( it = s.find( target, it ) ) != std::string::npos; it += rlen ) {
-			s.replace( it, tlen, repl );
+	struct branch {
+		size_t hits;
+		size_t size;
+		branch() : hits(0), size(0) {
 		}
-		return s;
-	};
-	std::vector< std::string > tokenize( const std::string &self, const std::string &delimiters ) {
-		std::string map( 256, '\0' );
-		for( std::string::const_iterator it = delimiters.begin(), end = delimiters.end(); it != end; ++it ) {
-			unsigned char ch( *it );
-			map[ ch ] = '\1';
+		branch( const branch &other ) {
+			operator=( other );
 		}
-		std::vector< std::string > tokens(1);
-		for( std::string::const_iterator it = self.begin(), end = self.end(); it != end; ++it ) {
-			unsigned char ch( *it );
-			/**/ if( !map.at(ch)          ) tokens.back().push_back( char(ch) );
-			else if( tokens.back().size() ) tokens.push_back( std::string() );
+		branch &operator =( const branch &other ) {
+			if( this != &other ) {
+				hits = other.hits;
+				size = other.size;
+			}
+			return *this;
 		}
-		while( tokens.size() && !tokens.back().size() ) tokens.pop_back();
-		return tokens;
-	}
-	bool match( const char *pattern, const char *str ) {
-		if( *pattern=='\0' ) return !*str;
-		if( *pattern=='*' )  return match(pattern+1, str) || (*str && match(pattern, str+1));
-		if( *pattern=='?' )  return *str && (*str != '.') && match(pattern+1, str+1);
-		return (*str == *pattern) && match(pattern+1, str+1);
-	}
-	bool matches( const std::string &self, const std::string &pattern ) {
-		return match( pattern.c_str(), self.c_str() );
-	}
-	bool endswith( const std::string &self, const std::string &eof ) {
-		return eof.size() < self.size() && self.substr( self.size() - eof.size() ) == eof;
-	}
+		branch &operator +=( const branch &other ) {
+			this->size += /*(other.hits ? other.hits : 1) **/ other.size;
+			return *this;
+		}
+		bool operator<( const double t ) const {
+			return size < t;
+		}
+
+		std::string str( double total ) const {
+			tracey::string os;
+			int pct = int((size * 100.0) / total);
+			/**/ if( pct >= 100 ) os << tracey::string(   "\1%", pct ) << " .. " << tracey::human( size );
+			else if( pct >=  10 ) os << tracey::string(  "0\1%", pct ) << " .. " << tracey::human( size );
+			else                  os << tracey::string( "00\1%", pct ) << " .. " << tracey::human( size );
+
+			if( hits > 1 ) os << " ; " << hits << " hits";
+			return os;
+		}
+	};
 }
 
-namespace route66 {
+namespace tracey {
 
-std::string tag( const std::string &pathfile ) {
-	static std::map< std::string, std::string> mimes;
-	if( mimes.empty() ) {
-		// [ref] taken from http://en.wikipedia.org/wiki/Internet_media_type
+	// callstack, demangle, lookup
+	using namespace heal;
+}
 
-		mimes[".avi"] = "video/avi";                  // Covers most Windows-compatible formats including .avi and .divx[16]
-		mimes[".mpg"] = "video/mpeg";                 // MPEG-1 video with multiplexed audio; Defined in RFC 2045 and RFC 2046
-		mimes[".mpeg"] = "video/mpeg";                // MPEG-1 video with multiplexed audio; Defined in RFC 2045 and RFC 2046
-		mimes[".mp4"] = "video/mp4";                  // MP4 video; Defined in RFC 4337
-		mimes[".mov"] = "video/quicktime";            // QuickTime video; Registered[17]
-		mimes[".webm"] = "video/webm";                // WebM Matroska-based open media format
-		mimes[".mkv"] = "video/x-matroska";           // Matroska open media format
-		mimes[".wmv"] = "video/x-ms-wmv";             // Windows Media Video; Documented in Microsoft KB 288102
-		mimes[".flv"] = "video/x-flv";                // Flash video (FLV files)
+namespace tracey
+{
+	namespace
+	{
+		volatile size_t timestamp_id = 0;
 
-		mimes[".css"] = "text/css";                   // Cascading Style Sheets; Defined in RFC 2318
-		mimes[".csv"] = "text/csv";                   // Comma-separated values; Defined in RFC 4180
-		mimes[".htm"] = "text/html";                  // HTML; Defined in RFC 2854
-		mimes[".html"] = "text/html";                 // HTML; Defined in RFC 2854
-		mimes[".txt"] = "text/plain";                 // Textual data; Defined in RFC 2046 and RFC 3676
-		mimes[".text"] = "text/plain";                // Textual data; Defined in RFC 2046 and RFC 3676
-		mimes[".rtf"] = "text/rtf";                   // RTF; Defined by Paul Lindner
-		mimes[".xml"] = "text/xml";                   // Extensible Markup Language; Defined in RFC 3023
-		mimes[".tsv"] = "text/tab-separated-values";
+#if kTraceySpinlocks
+		// test-and-test-and-set lock for short critical sections. waiters spin a while, then yield their timeslice.
+		class spinlock {
+			std::atomic<bool> locked;
 
-		mimes[".gif"] = "image/gif";                  // GIF image; Defined in RFC 2045 and RFC 2046
-		mimes[".jpg"] = "image/jpeg";                 // JPEG JFIF image; Defined in RFC 2045 and RFC 2046
-		mimes[".jpeg"] = "image/jpeg";                // JPEG JFIF image; Defined in RFC 2045 and RFC 2046
-		mimes[".pjpg"] = "image/pjpeg";               // JPEG JFIF image; Associated with Internet Explorer; Listed in ms775147(v=vs.85) - Progressive JPEG, initiated before global browser support for progressive JPEGs (Microsoft and Firefox).
-		mimes[".pjpeg"] = "image/pjpeg";              // JPEG JFIF image; Associated with Internet Explorer; Listed in ms775147(v=vs.85) - Progressive JPEG, initiated before global browser support for progressive JPEGs (Microsoft and Firefox).
-		mimes[".png"] = "image/png";                  // Portable Network Graphics; Registered,[13] Defined in RFC 2083
-		mimes[".svg"] = "image/svg+xml";              // SVG vector image; Defined in SVG Tiny 1.2 Specification Appendix M
-		mimes[".psd"] = "image/vnd.adobe.photoshop";
+			static void relax() {
+#if defined(__i386__) || defined(__x86_64__)
+				__builtin_ia32_pause();
+#elif defined(_M_IX86) || defined(_M_X64)
+				YieldProcessor();
+#endif
+			}
 
-		mimes[".aif"] = "audio/x-aiff";
-		mimes[".s3m"] = "audio/s3m";
-		mimes[".xm"] = "audio/xm";
-		mimes[".snd"] = "audio/x-adpcm";
-		mimes[".mp3"] = "audio/mpeg3";
-		mimes[".ogg"] = "audio/ogg";                  // Ogg Vorbis, Speex, Flac and other audio; Defined in RFC 5334
-		mimes[".opus"] = "audio/opus";                // Opus audio
-		mimes[".vorbis"] = "audio/vorbis";            // Vorbis encoded audio; Defined in RFC 5215
-		mimes[".wav"] = "audio/x-wav";
+			spinlock( const spinlock & );
+			spinlock &operator=( const spinlock & );
 
-		mimes[".atom"] = "application/atom+xml";      // Atom feeds
-		mimes[".dart"] = "application/dart";          // Dart files [8]
-		mimes[".ejs"] = "application/ecmascript";     // ECMAScript/JavaScript; Defined in RFC 4329 (equivalent to application/javascript but with stricter processing rules)
-		mimes[".json"] = "application/json";          // JavaScript Object Notation JSON; Defined in RFC 4627
-		mimes[".js"] = "application/javascript";      // ECMAScript/JavaScript; Defined in RFC 4329 (equivalent to application/ecmascript but with looser processing rules) It is not accepted in IE 8 or earlier - text/javascript is accepted but it is defined as obsolete in RFC 4329. The "type" attribute of the <script> tag in HTML5 is optional. In practice, omitting the media type of JavaScript programs is the most interoperable solution, since all browsers have always assumed the correct default even before HTML5.
-		mimes[".bin"] = "application/octet-stream";   // Arbitrary binary data.[9] Generally speaking this type identifies files that are not associated with a specific application. Contrary to past assumptions by software packages such as Apache this is not a type that should be applied to unknown files. In such a case, a server or application should not indicate a content type, as it may be incorrect, but rather, should omit the type in order to allow the recipient to guess the type.[10]
-		mimes[".pdf"] = "application/pdf";            // Portable Document Format, PDF has been in use for document exchange on the Internet since 1993; Defined in RFC 3778
-		mimes[".ps"] = "application/postscript";      // PostScript; Defined in RFC 2046
-		mimes[".rdf"] = "application/rdf+xml";        // Resource Description Framework; Defined by RFC 3870
-		mimes[".rss"] = "application/rss+xml";        // RSS feeds
-		mimes[".soap"] = "application/soap+xml";      // SOAP; Defined by RFC 3902
-		mimes[".font"] = "application/font-woff";     // Web Open Font Format; (candidate recommendation; use application/x-font-woff until standard is official)
-		mimes[".xhtml"] = "application/xhtml+xml";    // XHTML; Defined by RFC 3236
-		mimes[".xml"] = "application/xml";            // XML files; Defined by RFC 3023
-		mimes[".zip"] = "application/zip";            // ZIP archive files; Registered[11]
-		mimes[".gz"] = "application/gzip";            // Gzip, Defined in RFC 6713
-		mimes[".nacl"] = "application/x-nacl";        // Native Client web module (supplied via Google Web Store only)
-		mimes[".pnacl"] = "application/x-pnacl";      // Portable Native Client web module (may supplied by any website as it is safer than x-nacl)
-	};
+			public:
 
-	size_t ext = pathfile.find_last_of(".");
-	if( ext != std::string::npos ) {
-		std::map<std::string, std::string>::const_iterator found = mimes.find( &pathfile[ext] );
-		if( found != mimes.end() ) {
-			return found->second;
-		}
-	}
-	return mimes[".txt"];
-}
+			spinlock() : locked(false)
+			{}
 
-std::string mime( const std::string &filename_ext ) {
-	return std::string("Content-Type: ") + tag(filename_ext) + "; charset=utf-8\r\n";
-};
+			void lock() {
+				while( locked.exchange( true, std::memory_order_acquire ) ) {
+					for( unsigned spins = 0; locked.load( std::memory_order_relaxed ); ) {
+						if( ++spins < 64 ) relax(); else std::this_thread::yield();
+					}
+				}
+			}
+			void unlock() {
+				locked.store( false, std::memory_order_release );
+			}
+		};
+		typedef spinlock lock_t;
+#else
+		typedef std::mutex lock_t;
+#endif
 
-std::string interval_from_headers( const std::string &header, const std::string &text1, const std::string &text2 ) {
-	size_t pos = header.find(text1);
-	if( pos == std::string::npos ) {
-		return std::string();
-	}
-	pos += text1.size();
-	size_t pos2 = header.find(text2, pos);
-	if( pos2 == std::string::npos ) {
-		return header.substr(pos);
-	} else {
-		return header.substr(pos, pos2-pos);
-	}
-}
+		// tracey's own heap. memory is mapped straight from the OS, so bookkeeping never re-enters operator new,
+		// never mixes with the user heap, and its footprint (the overhead in reports) is known exactly.
+		// - small blocks are carved from 64 KB slabs, with a bump cursor and a free list per power-of-two size class.
+		// - bigger blocks are mapped on their own.
+		// - callers tell the size of every block they release, so blocks carry no headers.
+		class arena {
+			enum { min_shift = 4, max_shift = 14, num_classes = max_shift - min_shift + 1, slab_size = 1 << 16, page_size = 4096 };
 
-std::string extract_from_headers( const std::string &header, const std::string &text ) {
-	size_t pos = header.find(text);
-	if( pos == std::string::npos ) {
-		return std::string();
-	}
-	pos += text.size();
-	size_t pos2 = header.find( "\r\n", pos );
-	if( pos2 == std::string::npos ) {
-		return header.substr(pos);
-	} else {
-		return header.substr(pos, pos2-pos);
-	}
-}
+			struct node {
+				node *next;
+			};
 
-struct daemon {
-	int socket;
-	const std::map< std::string /*path*/, route66::callback /*fn*/ > *routers;
-	std::string base;
+			struct bin {
+				lock_t mutex;
+				node *free;
+				char *cursor, *end;
+				char padding[ 64 ];
+			} bins[ num_classes ];
 
-	daemon() : socket(-1), routers(0)
-	{}
+			std::atomic<size_t> mapped;
+
+			static unsigned class_of( size_t bytes ) {
+				unsigned c = 0;
+				while( ( size_t(1) << ( min_shift + c ) ) < bytes ) ++c;
+				return c;
+			}
+			static size_t pages( size_t bytes ) {
+				return ( bytes + page_size - 1 ) & ~size_t( page_size - 1 );
+			}
+
+			void *map( size_t bytes ) {
+				$windows(
+					void *ptr = VirtualAlloc( 0, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+				)
+				$welse(
+					void *ptr = mmap( 0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+					if( ptr == MAP_FAILED ) ptr = 0;
+				)
+				if( !ptr ) {
+					tracey::badalloc();
+				}
+				mapped += bytes;
+				return ptr;
+			}
+			void unmap( void *ptr, size_t bytes ) {
+				$windows( VirtualFree( ptr, 0, MEM_RELEASE ); )
+				$welse( munmap( ptr, bytes ); )
+				mapped -= bytes;
+			}
 
-	void operator()() {
-		bool shutdown = false;
-		while( !shutdown ) {
-			enum { buflen = 1024 * 1024, SPACES = 2 /*>=2*/ };
+			arena( const arena & );
+			arena &operator=( const arena & );
 
-			int child = ACCEPT(socket,0,0), o = 0, h[SPACES] = {}, hi = 0;
-			if( child < 0 ) continue;
+			public:
 
-			std::string buf( buflen, '\0' );
-			char *b = &buf[0];
+			arena() : mapped(0) {
+				for( unsigned c = 0; c < num_classes; ++c ) {
+					bins[c].free = 0;
+					bins[c].cursor = bins[c].end = 0;
+				}
+			}
 
-			while(hi<SPACES&&o<buflen) {
-				int n = READ(child,b+o,buflen-o);
-				if(n<=0) { break; }
-				else {
-					int i = o;
-					o+=n;
-					for(;i<n&&hi<SPACES;i++) {
-					if((hi < SPACES) && b[i] == ' ') { h[hi++] = i; }
+			void *allocate( size_t bytes ) {
+				if( !bytes ) {
+					return 0;
+				}
+				if( bytes > ( size_t(1) << max_shift ) ) {
+					return map( pages( bytes ) );
+				}
+				unsigned c = class_of( bytes );
+				bin &b = bins[c];
+				b.mutex.lock();
+				void *ptr = b.free;
+				if( ptr ) {
+					b.free = b.free->next;
+				} else {
+					if( b.cursor == b.end ) {
+						b.cursor = (char *)map( slab_size );
+						b.end = b.cursor + slab_size;
 					}
+					ptr = b.cursor;
+					b.cursor += size_t(1) << ( min_shift + c );
 				}
+				b.mutex.unlock();
+				return ptr;
 			}
 
-			if(hi >= SPACES) {
-				b[ o ] = '\0';
-				buf.resize( o );
+			// bytes must be the size given when ptr was allocated
+			void deallocate( void *ptr, size_t bytes ) {
+				if( !ptr ) {
+					return;
+				}
+				if( bytes > ( size_t(1) << max_shift ) ) {
+					unmap( ptr, pages( bytes ) );
+					return;
+				}
+				bin &b = bins[ class_of( bytes ) ];
+				b.mutex.lock();
+				node *n = (node *)ptr;
+				n->next = b.free;
+				b.free = n;
+				b.mutex.unlock();
+			}
 
-				const char *logmask = std::getenv("R66LOG");
-				if( logmask ) {
-					if( matches(b, logmask) ) {
-						//__asm int 3;
-						//fprintf(stdout, "%s,%s\n", multipart.c_str(), boundary.c_str());
-					}
+			void *reallocate( void *ptr, size_t from, size_t to ) {
+				void *fresh = allocate( to );
+				if( ptr && fresh ) {
+					std::memcpy( fresh, ptr, from < to ? from : to );
 				}
+				deallocate( ptr, from );
+				return fresh;
+			}
 
-				typedef std::map< std::string, std::string > filemap;
-				static std::map< std::string /*boundary*/, filemap > boundaries;
+			// bytes mapped from the OS
+			size_t footprint() const {
+				return mapped;
+			}
 
-				unsigned curlen = 0;
+			// holds every bin still (see container::freeze)
+			void lock() {
+				for( unsigned c = 0; c < num_classes; ++c ) {
+					bins[c].mutex.lock();
+				}
+			}
+			void unlock() {
+				for( unsigned c = num_classes; c-- > 0; ) {
+					bins[c].mutex.unlock();
+				}
+			}
+		};
 
-				std::string boundary = std::string("--") + extract_from_headers( buf, "Content-Type: multipart/form-data; boundary=");
-				std::string eof = boundary + "--\r\n";
-				std::string headers = buf.substr( 0, buf.find("\r\n\r\n") + 4 );
-				std::string payload = buf.substr( headers.size() );
+		// never destroyed: tracked memory keeps being released into it during static destruction
+		arena &metadata() {
+			static union { char bytes[ sizeof(arena) ]; void *align_ptr; uint64_t align_u64; double align_double; } placement;
+			static arena *heap = new (&placement) arena();
+			return *heap;
+		}
 
-				while( boundary.size() > 2 && !endswith( payload, eof ) ) {
-					std::stringstream head1, head2;
-					head1 << "HTTP/1.1 100 Continue\r\n";
-					WRITE( child, head1.str().c_str(), head1.str().size() );
+		// 0 tracks every allocation, else about one allocation every N bytes (see tracey::sampling())
+		std::atomic<size_t> sampling_interval( kTraceySamplingInterval );
 
-					o = 0;
-					buf.clear();
-					buf.resize( buflen, '\0' );
+		// a sampled record stands for `weight` allocations like itself
+		size_t scaled( size_t value, float weight ) {
+			return weight == 1 ? value : size_t( value * double( weight ) + 0.5 );
+		}
 
-					int n;
-					n = READ(child,b+o,buflen-o);
-					if(n<=0) { break; }
+		// allocation counts are summed in fixed point, so rounding every sampled record does not bias totals
+		enum { count_unit = 256 };
+		size_t counted( size_t units ) {
+			return ( units + count_unit / 2 ) / count_unit;
+		}
 
-					buf.resize( n );
+		struct stats_t {
+			size_t usage, usage_peak, num_leaks, leak_peak, overhead, sampling;
+			stats_t() : usage(0), usage_peak(0), num_leaks(0), leak_peak(0), overhead(0), sampling(0) {}
+			std::string str() const {
+				std::string out = tracey::string("highest peak: \1 total, \2 greatest peak // \3 allocs in use: \4 + overhead: \5 = total: \6",
+									human(usage_peak), human(leak_peak), num_leaks, human(usage), human(overhead), human( usage + overhead ) );
+				if( sampling ) {
+					out += tracey::string( " (estimated; sampling 1 allocation every \1 on average)", human(sampling) );
+				}
+				return out;
+			}
+		};
 
-					payload += buf;
+		// stats are split in lanes, one per registry shard, and a lane is only written under the lock of its shard.
+		// readers add the lanes up and never lock. usage is also published into a global total in batches of up to
+		// `slack` bytes per lane, so the total is off by less than num_lanes * slack, and usage cannot beat the peak
+		// unless the total is that close to it. there every lane is flushed, and then every update is published right
+		// away until usage falls well below the peak again, so the peak is exact.
+		// no constructor: this is zero-initialized before any static constructor (or allocation) runs
+		struct atomic_stats_t {
+			enum { num_lanes = kTraceyRegistryShards > 0 ? kTraceyRegistryShards : 1, slack = 16 * 1024 };
+
+			struct lane {
+				std::atomic<size_t> usage, num_leaks /*in count_units*/, overhead /*besides the arena*/;
+				std::atomic<ptrdiff_t> pending;   // usage not published yet. flushes of other threads take it too
+				char padding[ 64 ];
+			} lanes[ num_lanes ];
+
+			std::atomic<size_t> published, usage_peak, leak_peak;
+			std::atomic<bool> exact;             // set close to the peak
+
+			// single writer (the lane owner), so no read-modify-write is needed
+			static void bump( std::atomic<size_t> &counter, size_t delta ) {
+				counter.store( counter.load( std::memory_order_relaxed ) + delta, std::memory_order_relaxed );
+			}
+			static void raise( std::atomic<size_t> &peak, size_t value ) {
+				for( size_t old = peak.load( std::memory_order_relaxed ); value > old && !peak.compare_exchange_weak( old, value ); )
+				{}
+			}
+			size_t publish( lane &l ) {
+				ptrdiff_t delta = l.pending.exchange( 0 );
+				return published.fetch_add( size_t( delta ) ) + size_t( delta );
+			}
+			// publishes all lanes at once, so the total is exact and the peak can be raised from it
+			void flush() {
+				ptrdiff_t delta = 0;
+				for( unsigned i = 0; i < num_lanes; ++i ) {
+					delta += lanes[i].pending.exchange( 0 );
+				}
+				raise( usage_peak, published.fetch_add( size_t( delta ) ) + size_t( delta ) );
+			}
+			bool within( size_t distance ) const {
+				return published.load( std::memory_order_relaxed ) + distance >= usage_peak.load( std::memory_order_relaxed );
+			}
+			void update( lane &l, ptrdiff_t bytes ) {
+				l.pending += bytes;
+				if( exact ) {
+					raise( usage_peak, publish( l ) );
+					if( !within( 2 * size_t( num_lanes ) * slack ) ) exact = false;
+					return;
+				}
+				ptrdiff_t pending = l.pending.load( std::memory_order_relaxed );
+				if( pending >= ptrdiff_t( slack ) || pending <= -ptrdiff_t( slack ) ) {
+					publish( l );
 				}
+				if( within( size_t( num_lanes ) * slack ) ) {
+					exact = true;
+					flush();
+				}
+			}
 
-				route66::request rq;
+			// overhead is kept: it belongs to in-band headers of blocks that are still allocated
+			void reset() {
+				for( unsigned i = 0; i < num_lanes; ++i ) {
+					lanes[i].usage = lanes[i].num_leaks = 0;
+					lanes[i].pending = 0;
+				}
+				published = usage_peak = leak_peak = 0;
+				exact = false;
+			}
+			void add( unsigned at, size_t size, float weight = 1 ) {
+				lane &l = lanes[ at ];
+				size_t bytes = scaled( size, weight );
+				bump( l.num_leaks, scaled( count_unit, weight ) );
+				bump( l.usage, bytes );
+				if( size > leak_peak.load( std::memory_order_relaxed ) ) {
+					raise( leak_peak, size );
+				}
+				update( l, ptrdiff_t( bytes ) );
+			}
+			void sub( unsigned at, size_t size, float weight = 1 ) {
+				lane &l = lanes[ at ];
+				size_t bytes = scaled( size, weight );
+				bump( l.num_leaks, 0 - scaled( count_unit, weight ) );
+				bump( l.usage, 0 - bytes );
+				update( l, -ptrdiff_t( bytes ) );
+			}
+			void charge( unsigned at, size_t bytes ) {
+				bump( lanes[ at ].overhead, bytes );
+			}
 
-				if( boundary.size() > 2 ) {
-					payload = interval_from_headers( payload, boundary + "\r\n", boundary );
+			operator stats_t() const {
+				stats_t st;
+				for( unsigned i = 0; i < num_lanes; ++i ) {
+					st.usage += lanes[i].usage.load( std::memory_order_relaxed );
+					st.num_leaks += lanes[i].num_leaks.load( std::memory_order_relaxed );
+					st.overhead += lanes[i].overhead.load( std::memory_order_relaxed );
+				}
+				st.usage_peak = std::max( size_t( usage_peak ), st.usage );
+				st.num_leaks = counted( st.num_leaks );
+				st.leak_peak = leak_peak;
+				st.overhead += metadata().footprint();
+				st.sampling = sampling_interval;
+				return st;
+			}
+			std::string str() const {
+				return stats_t(*this).str();
+			}
+		} stats;
 
-					{
-						std::string headers = payload.substr( 0, payload.find("\r\n\r\n") + 4 );
-						std::string file = extract_from_headers( headers, "Content-Disposition: form-data; name=");
-						file = file.substr( 1, file.size() - 2 ); // remove ""
+		// ids grow in allocation order. async tracking relies on them to order events from different threads.
+		// no constructor: this is zero-initialized before any static constructor (or allocation) runs
+		std::atomic<size_t> last_id;
 
-						payload = payload.substr( headers.size() );
-						rq.multipart[ file ] = payload;
-					}
+		size_t create_id() {
+			return ++last_id;
+		}
 
-					buf = headers;
-				}
+		// sampling: every thread counts bytes down to its next sample. gaps are exponential (a poisson process over bytes),
+		// so an allocation of n bytes is sampled with probability 1-exp(-n/interval), and is weighted by its inverse.
+		static $tls(double) sample_countdown = 0;
+		static $tls(uint64_t) sample_seed = 0;
 
-				rq.data = buf;
+		double sample_gap( size_t interval ) {
+			if( !sample_seed ) {
+				sample_seed = ( uint64_t( uintptr_t( &sample_seed ) ) ^ ( uint64_t( create_id() ) * 0x9E3779B97F4A7C15ULL ) ) | 1;
+				sample_countdown = 0;
+			}
+			// xorshift64*
+			sample_seed ^= sample_seed >> 12;
+			sample_seed ^= sample_seed << 25;
+			sample_seed ^= sample_seed >> 27;
+			double u = double( ( sample_seed * 0x2545F4914F6CDD1DULL ) >> 11 ) / double( uint64_t(1) << 53 );
+			return -std::log( 1.0 - u ) * interval;
+		}
 
-				char org = b[h[1]];
-				b[h[1]] = '\0';
+		// returns the weight of this allocation, or 0 if it is not sampled
+		float sample( size_t size, size_t interval ) {
+			if( !sample_seed ) {
+				sample_countdown = sample_gap( interval );
+			}
+			if( ( sample_countdown -= double( size ) ) > 0 ) {
+				return 0;
+			}
+			sample_countdown = sample_gap( interval );
+			return float( 1.0 / ( 1.0 - std::exp( -double( size ) / interval ) ) );
+		}
 
-#if 1
-				socklen_t len;
-				struct sockaddr_storage addr;
-				char ipstr[INET_ADDRSTRLEN];
-				len = sizeof addr;
-				getpeername(child, (struct sockaddr*) &addr, &len);
-				struct sockaddr_in *s = (struct sockaddr_in *) &addr;
-				inet_ntop(AF_INET, &s->sin_addr, ipstr, sizeof ipstr);
-				if( std::strcmp("127.0.0.1", ipstr) == 0 ) rq.ip = "localhost";
-				else rq.ip = ipstr;
+		bool view_report( const std::string &html ) {
+			$windows( return std::system( tracey::string("start \1", html).c_str() ), true );
+			$apple( return std::system( tracey::string("open \1", html).c_str() ), true );
+			$linux( return std::system( tracey::string("xdg-open \1", html).c_str() ), true );
+			return false;
+		}
 
-				struct sockaddr_in l;
-				len = sizeof(l);
-				if (getsockname(child, (struct sockaddr *)&l, &len) != -1) {
-					rq.port = ntohs(l.sin_port);
-				} else {
-					rq.port = 0;
-				}
-#endif
+		std::string get_temp_pathfile() {
+			$windows(
+				std::string path = std::string( std::getenv("TEMP") ? std::getenv("TEMP") : "." ) + std::tmpnam(0);
+				while( path.size() && path.at( path.size() - 1 ) == '.' ) path.resize( path.size() - 1 );
+				return path;
+			)
+			$welse(
+				return std::string() + std::tmpnam(0);
+			)
+		}
+	}
 
-				std::string method( b, h[0] );
-				std::string url( &b[h[0]+1] ); //skip "GET "
-				b[h[1]] = org;
+	namespace detail
+	{
+		// a tracked allocation. its callstack lives in the depot; the record only keeps the stack id.
+		struct leak {
+			const void *addr;
+			size_t size, id;
+			unsigned stack;
+			float weight;
 
-				std::string path, options;
+			leak() : addr(0), size(0), id(0), stack(0), weight(1)
+			{}
 
-				size_t mark = url.find_first_of('?');
-				if( mark == std::string::npos ) {
-					path = url;
-				} else {
-					path = url.substr( 0, mark );
-					options = url.substr( mark + 1 );
+			void wipe() {
+				*this = leak();
+			}
+
+			// estimated allocations (in count_units) and bytes behind this record (exact unless sampling)
+			size_t count() const {
+				return scaled( count_unit, weight );
+			}
+			size_t bytes() const {
+				return scaled( size, weight );
+			}
+		};
+
+#if kTraceyInbandHeaders
+		// in-band mode: tracey operator new places this header right before every block, so operator delete finds the
+		// record in O(1). tracked headers are chained into the list of their shard, so reports still see every allocation.
+		// magic is the last word before the block: probing a foreign pointer only reads the word right before it, which
+		// most allocators keep mapped for their own chunk headers.
+		struct header {
+			leak record;
+			header *prev, *next;
+			size_t magic;
+
+			// bytes taken in front of the block, so the block keeps the alignment of the underlying allocator
+			static size_t space() {
+				return ( sizeof(header) + 15 ) & ~size_t(15);
+			}
+			static header *of( const void *ptr ) {
+				return (header *)( (char *)ptr - sizeof(header) );
+			}
+			void *block() {
+				return (char *)( this + 1 ) - space();
+			}
+			size_t sign( bool tracked ) const {
+				size_t hash = size_t( uint64_t( uintptr_t( this ) ) * 0x9E3779B97F4A7C15ULL );
+				return hash ^ ( tracked ? size_t(0x74726163) : size_t(0x65796f6b) );
+			}
+		};
+#endif
+
+		// open-addressing hash table of records keyed by their own address (V::addr).
+		// - linear probing, no per-record heap nodes. a null addr marks an empty slot.
+		// - removals do backward-shifting, so probe sequences never degrade with tombstones.
+		// - growth is incremental: the previous table is kept alongside and migrated a few slots per update,
+		//   so no single allocation has to pay for rehashing millions of records.
+		// - memory comes from the metadata arena, so it never re-enters the tracked operator new.
+		template<typename V>
+		class table {
+			enum { migration_steps = 16, min_capacity = 64 };
+
+			V *slots, *old;
+			size_t capacity, old_capacity, cursor, count;
+			unsigned bits, old_bits;
+
+			static const void *tombstone() {
+				return (const void *)1;
+			}
+			static size_t home( const void *key, unsigned bits ) {
+				uint64_t hash = uint64_t( uintptr_t( key ) >> 4 ) * 0x9E3779B97F4A7C15ULL;
+				return size_t( hash >> ( 64 - bits ) );
+			}
+
+			static V *allocate( size_t n ) {
+				V *v = (V *)metadata().allocate( n * sizeof(V) );
+				for( size_t i = 0; i < n; ++i ) {
+					new (v + i) V();
+				}
+				return v;
+			}
+			static void release( V *v, size_t n ) {
+				if( v ) {
+					for( size_t i = 0; i < n; ++i ) {
+						v[i].~V();
+					}
+					metadata().deallocate( v, n * sizeof(V) );
 				}
+			}
 
-				if( method == "PUT" || method == "POST" )  {
-					options = &b[ std::string(b).find("\r\n\r\n") + 4 ];
+			V *lookup( V *v, unsigned b, size_t cap, const void *key ) const {
+				for( size_t i = home( key, b ), mask = cap - 1; v[i].addr; i = (i + 1) & mask ) {
+					if( v[i].addr == key ) return &v[i];
 				}
+				return 0;
+			}
 
-				std::string route = method + " " + path;
-				std::map< std::string, route66::callback >::const_iterator found = routers->find( route );
-				if( found == routers->end() ) {
-					// bad route, try index wildcard matching
-					for( found = routers->begin(); found != routers->end(); ++found ) {
-						if( matches( route, found->first ) ) {
-							break;
-						}
+			V &place( const void *key ) {
+				size_t mask = capacity - 1, i = home( key, bits );
+				while( slots[i].addr ) i = (i + 1) & mask;
+				return slots[i];
+			}
+
+			void migrate( size_t steps ) {
+				for( ; old && steps--; ++cursor ) {
+					if( cursor == old_capacity ) {
+						release( old, old_capacity );
+						old = 0;
+						break;
+					}
+					V &from = old[cursor];
+					if( from.addr && from.addr != tombstone() ) {
+						std::swap( from, place( from.addr ) );
+						from.addr = tombstone();
 					}
 				}
-				if( found == routers->end() ) {
-					// bad route, try index fallback
-					found = routers->find("GET /");
+			}
+
+			void grow() {
+				if( old ) {
+					migrate( ~size_t(0) );
 				}
+				old = slots, old_capacity = capacity, old_bits = bits, cursor = 0;
+				capacity *= 2, bits++;
+				slots = allocate( capacity );
+			}
 
-				if( found != routers->end() ) {
+			table( const table & );
+			table &operator=( const table & );
 
-					rq.method = method;
-					rq.url = url;
-					rq.uri = path;
-					rq.options = options;
+			public:
 
-					urldecode2( rq.uri );
+			table() : slots(0), old(0), capacity(min_capacity), old_capacity(0), cursor(0), count(0), bits(6), old_bits(0) {
+				slots = allocate( capacity );
+			}
+			~table() {
+				release( old, old_capacity );
+				release( slots, capacity );
+			}
 
-					// arguments
-					std::vector< std::string > split = tokenize( options, "&" );
-					for( std::vector< std::string >::const_iterator it = split.begin(), end = split.end(); it != end; ++it ) {
-						const std::string &glued = *it;
-						std::vector< std::string > pair = tokenize( glued, "=" );
-						if( 2 == pair.size() ) {
-							rq.arguments[ urldecode2(pair[0]) ] = urldecode2(pair[1]);
-						} else {
-							rq.arguments[ urldecode2(pair[0]) ] = std::string();
-						}
-					}
+			size_t size() const {
+				return count;
+			}
 
-					// normalize & rebase (if needed)
-					if( rq.uri == "" || rq.uri == "/" ) rq.uri = "index.html";
-					rq.uri = base + rq.uri;
+			V *find( const void *key ) {
+				V *v = lookup( slots, bits, capacity, key );
+				return v || !old ? v : lookup( old, old_bits, old_capacity, key );
+			}
 
-					if( logmask ) {
-						char addr[64]; sprintf(addr, "%s:%d", rq.ip.c_str(), rq.port );
-						if( matches(addr, logmask) || matches(rq.uri, logmask) || matches(rq.data, logmask) ) {
-							fprintf(stdout, "%s - %s\n%s\n", addr, rq.uri.c_str(), rq.str().c_str());
-						}
-					}
+			// key must not be present already
+			V &insert( const void *key ) {
+				migrate( migration_steps );
+				if( (count + 1) * 4 > capacity * 3 ) {
+					grow();
+				}
+				V &v = place( key );
+				v.addr = key;
+				++count;
+				return v;
+			}
 
-					{
-						const route66::callback &fn = found->second;
-						std::stringstream headers, contents;
-						int httpcode = fn( rq, headers, contents );
+			// slot must come from find()
+			void erase( V *v ) {
+				--count;
+				if( old && v >= old && v < old + old_capacity ) {
+					v->wipe();
+					v->addr = tombstone();
+					migrate( migration_steps );
+					return;
+				}
+				size_t mask = capacity - 1, i = size_t( v - slots ), j = i;
+				for(;;) {
+					j = (j + 1) & mask;
+					if( !slots[j].addr ) break;
+					size_t k = home( slots[j].addr, bits );
+					// slot j may be shifted back into the hole at i only if its home is not in the cyclic range (i, j]
+					if( i <= j ? ( i < k && k <= j ) : ( i < k || k <= j ) ) continue;
+					std::swap( slots[i], slots[j] );
+					i = j;
+				}
+				slots[i].wipe();
+				migrate( migration_steps );
+			}
+
+			void clear() {
+				release( old, old_capacity );
+				release( slots, capacity );
+				old = 0, old_capacity = 0, cursor = 0, count = 0;
+				capacity = min_capacity, bits = 6;
+				slots = allocate( capacity );
+			}
+
+			// live records, sorted by address
+			void sorted( std::vector< const V *, arena_allocator< const V * > > &out ) const {
+				size_t from = out.size();
+				for( size_t i = 0; i < capacity; ++i ) {
+					if( slots[i].addr ) out.push_back( &slots[i] );
+				}
+				for( size_t i = 0; old && i < old_capacity; ++i ) {
+					if( old[i].addr && old[i].addr != tombstone() ) out.push_back( &old[i] );
+				}
+				std::sort( out.begin() + from, out.end(), by_address );
+			}
 
-						std::string datas = contents.str();
-						shutdown = ( 0 == httpcode ? true : false );
+			static bool by_address( const V *a, const V *b ) {
+				return a->addr < b->addr;
+			}
+		};
 
-						if( !shutdown && datas.size() ) {
-							std::stringstream head1, head2;
-							head1 << "HTTP/1.1 " << httpcode << " OK\r\n";
-							head2 << headers.str() << "Content-Length: " << datas.size() << "\r\n\r\n";
+		// deduplicated callstacks. every unique trace is stored once and named by a 32-bit id (0 = no stack).
+		// traces are refcounted by the leaks pointing to them, so stacks with no remaining allocations are reclaimed.
+		// the depot is striped by trace hash, every stripe with its own lock, so interning scales like the registry.
+		class depot {
+			enum { stripe_bits = 4, num_stripes = 1 << stripe_bits, min_capacity = 64 };
 
-							WRITE( child, head1.str().c_str(), head1.str().size() );
-							WRITE( child, head2.str().c_str(), head2.str().size() );
-							if( method != "HEAD" )
-							WRITE( child, datas.c_str(), datas.size() );
-						}
-					}
+			struct trace {
+				size_t hash, refs;
+				unsigned num_frames, next_free;
+				void **frames;
+			};
 
+			struct stripe {
+				lock_t mutex;
+				// traces are addressed by position; index is an open-addressing hash set of positions + 1
+				trace *traces;
+				unsigned *index;
+				unsigned capacity, used, free_list, index_capacity, count;
+				char padding[ 64 ];
+			} stripes[ num_stripes ];
+
+			static void *resize( void *ptr, size_t from, size_t to ) {
+				return metadata().reallocate( ptr, from, to );
+			}
+
+			static size_t hash_of( void *const *frames, unsigned num_frames ) {
+				uint64_t hash = 0xcbf29ce484222325ULL ^ num_frames;
+				for( unsigned i = 0; i < num_frames; ++i ) {
+					hash = ( hash ^ uint64_t( uintptr_t( frames[i] ) ) ) * 0x100000001b3ULL;
 				}
+				hash ^= hash >> 33;
+				hash *= 0xff51afd7ed558ccdULL;
+				hash ^= hash >> 33;
+				return size_t( hash );
+			}
 
-				SHUTDOWN(child);
-				CLOSE(child);
+			static unsigned home( const stripe &st, size_t hash ) {
+				return unsigned( ( hash >> stripe_bits ) & ( st.index_capacity - 1 ) );
 			}
-		}
-	}
-};
 
-namespace {
+			static void reindex( stripe &st, unsigned capacity ) {
+				resize( st.index, st.index_capacity * sizeof(unsigned), 0 );
+				st.index = (unsigned *)resize( 0, 0, capacity * sizeof(unsigned) );
+				std::memset( st.index, 0, capacity * sizeof(unsigned) );
+				st.index_capacity = capacity;
+				for( unsigned t = 0; t < st.used; ++t ) {
+					if( st.traces[t].refs ) {
+						unsigned i = home( st, st.traces[t].hash );
+						while( st.index[i] ) i = (i + 1) & (capacity - 1);
+						st.index[i] = t + 1;
+					}
+				}
+			}
 
-	typedef std::map< std::string /*path*/, route66::callback /*fn */> routers;
+			depot( const depot & );
+			depot &operator=( const depot & );
 
-	bool create( unsigned port, const std::string &mask, const route66::callback &fn, std::string base ) {
-		static std::map< unsigned, routers > daemons;
+			public:
 
-		if( daemons.find(port) == daemons.end() ) {
-			INIT();
-			int socket = SOCKET(PF_INET, SOCK_STREAM, IPPROTO_IP);
-			if( socket < 0 ) {
-				return "cannot init socket", false;
+			depot() {
+				for( unsigned s = 0; s < num_stripes; ++s ) {
+					stripe &st = stripes[s];
+					st.traces = 0;
+					st.capacity = st.used = st.free_list = st.count = 0;
+					st.index = (unsigned *)resize( 0, 0, min_capacity * sizeof(unsigned) );
+					std::memset( st.index, 0, min_capacity * sizeof(unsigned) );
+					st.index_capacity = min_capacity;
+				}
 			}
 
-			struct sockaddr_in l;
-			std::memset( &l, 0, sizeof(sockaddr_in) );
-			l.sin_family = AF_INET;
-			l.sin_port = htons(port);
-			l.sin_addr.s_addr = INADDR_ANY;
-	#       if !defined(_WIN32)
-			int r = 1; setsockopt(socket,SOL_SOCKET,SO_REUSEADDR,&r,sizeof(r));
-	#       endif
-			BIND(socket,(struct sockaddr *)&l,sizeof(l));
-			LISTEN(socket,5);
+			// holds every stripe still (see container::freeze)
+			void lock() {
+				for( unsigned s = 0; s < num_stripes; ++s ) {
+					stripes[s].mutex.lock();
+				}
+			}
+			void unlock() {
+				for( unsigned s = num_stripes; s-- > 0; ) {
+					stripes[s].mutex.unlock();
+				}
+			}
 
-			route66::daemon dm;
-			dm.socket = socket;
-			dm.routers = &daemons[ port ];
-			dm.base = base;
-			std::thread( dm ).detach();
-		}
+			// returns the id of given trace, storing it if new. every call adds a reference.
+			unsigned intern( void *const *frames, unsigned num_frames ) {
+				if( !num_frames ) {
+					return 0;
+				}
+				size_t hash = hash_of( frames, num_frames );
+				unsigned s = unsigned( hash & (num_stripes - 1) );
+				stripe &st = stripes[s];
+				st.mutex.lock();
+
+				unsigned i = home( st, hash ), mask = st.index_capacity - 1;
+				for( ; st.index[i]; i = (i + 1) & mask ) {
+					trace &t = st.traces[ st.index[i] - 1 ];
+					if( t.hash == hash && t.num_frames == num_frames && !std::memcmp( t.frames, frames, num_frames * sizeof(void *) ) ) {
+						t.refs++;
+						unsigned id = ( st.index[i] << stripe_bits ) | s;
+						st.mutex.unlock();
+						return id;
+					}
+				}
 
-		daemons[ port ][ mask ] = fn;
+				unsigned pos;
+				if( st.free_list ) {
+					pos = st.free_list - 1;
+					st.free_list = st.traces[pos].next_free;
+				} else {
+					if( st.used == st.capacity ) {
+						unsigned capacity = st.capacity ? st.capacity * 2 : unsigned( min_capacity );
+						st.traces = (trace *)resize( st.traces, st.capacity * sizeof(trace), capacity * sizeof(trace) );
+						st.capacity = capacity;
+					}
+					pos = st.used++;
+				}
 
-		return "ok", true;
-	}
-}
+				trace &t = st.traces[pos];
+				t.hash = hash;
+				t.refs = 1;
+				t.num_frames = num_frames;
+				t.next_free = 0;
+				t.frames = (void **)resize( 0, 0, num_frames * sizeof(void *) );
+				std::memcpy( t.frames, frames, num_frames * sizeof(void *) );
 
-bool create( unsigned port, const std::string &mask, const route66::callback &fn ) {
-	return create( port, mask, fn, std::string() );
-}
+				if( ( st.count + 1 ) * 4 > st.index_capacity * 3 ) {
+					reindex( st, st.index_capacity * 2 );
+				} else {
+					st.index[i] = pos + 1;
+				}
+				st.count++;
 
-namespace {
+				unsigned id = ( (pos + 1) << stripe_bits ) | s;
+				st.mutex.unlock();
+				return id;
+			}
 
-	std::string get_app_folder() {
-#       ifdef _WIN32
-			char s_path[MAX_PATH] = {0};
-			const size_t len = MAX_PATH;
+			// drops a reference. unreferenced traces are reclaimed.
+			void release( unsigned id ) {
+				if( !id ) {
+					return;
+				}
+				stripe &st = stripes[ id & (num_stripes - 1) ];
+				unsigned pos = ( id >> stripe_bits ) - 1;
+				st.mutex.lock();
+
+				trace &t = st.traces[pos];
+				if( --t.refs == 0 ) {
+					unsigned mask = st.index_capacity - 1, i = home( st, t.hash );
+					while( st.index[i] != pos + 1 ) i = (i + 1) & mask;
+					for( unsigned j = i;; ) {
+						j = (j + 1) & mask;
+						if( !st.index[j] ) break;
+						unsigned k = home( st, st.traces[ st.index[j] - 1 ].hash );
+						if( i <= j ? ( i < k && k <= j ) : ( i < k || k <= j ) ) continue;
+						st.index[i] = st.index[j];
+						i = j;
+					}
+					st.index[i] = 0;
+					st.count--;
+
+					resize( t.frames, t.num_frames * sizeof(void *), 0 );
+					t.frames = 0;
+					t.num_frames = 0;
+					t.next_free = st.free_list;
+					st.free_list = pos + 1;
+				}
 
-			HMODULE mod = 0;
-			::GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCSTR)&get_app_folder, &mod);
-			DWORD size = ::GetModuleFileNameA(mod, s_path, (DWORD)len);
+				st.mutex.unlock();
+			}
 
-			while( size > 0 ) {
-				if( s_path[size] == '\\' ) {
-					s_path[size+1] = '\0';
-					return s_path;
+			// copies the frames of given stack into out
+			void frames( unsigned id, std::vector<void *> &out ) {
+				out.clear();
+				if( !id ) {
+					return;
 				}
-				--size;
+				stripe &st = stripes[ id & (num_stripes - 1) ];
+				st.mutex.lock();
+				const trace &t = st.traces[ ( id >> stripe_bits ) - 1 ];
+				out.assign( t.frames, t.frames + t.num_frames );
+				st.mutex.unlock();
 			}
-			return std::string();
-#       else
-			char arg1[20];
-			char exepath[PATH_MAX + 1] = {0};
 
-			sprintf( arg1, "/proc/%d/exe", getpid() );
-			readlink( arg1, exepath, 1024 );
-			return std::string( exepath );
-#       endif
-	}
+			// number of unique stacks
+			size_t size() {
+				size_t n = 0;
+				for( unsigned s = 0; s < num_stripes; ++s ) {
+					stripes[s].mutex.lock();
+					n += stripes[s].count;
+					stripes[s].mutex.unlock();
+				}
+				return n;
+			}
+		};
 
-	int file_reader( route66::request &request, std::ostream &headers, std::ostream &contents ) {
-		std::ifstream ifs( request.uri.c_str(), std::ios::binary );
-		if( ifs.good() ) {
-			headers << route66::mime(request.uri);
-			contents << ifs.rdbuf();
-			return 200;
-		} else {
-			headers << route66::mime(".text");
-			contents << "404: not found" << std::endl;
-			//contents << request.uri << std::endl;
-			return 404;
-		}
+#if kTraceyAsyncTracking
+		// an allocation (size > 0) or a deallocation (size == 0), as seen by the thread that did it
+		struct event {
+			const void *addr;
+			size_t size, id;
+			unsigned stack;
+			float weight;
+		};
+
+		// single-producer/single-consumer queue of events. its thread pushes, the drainer pops.
+		struct ring {
+			enum { capacity = kTraceyAsyncRingSize, mask = capacity - 1 };
+			typedef char capacity_must_be_a_power_of_two[ ( capacity & mask ) == 0 ? 1 : -1 ];
+
+			std::atomic<size_t> head;     // drainer side
+			char padding0[ 64 ];
+			std::atomic<size_t> tail;     // producer side
+			std::atomic<size_t> claim;    // lower bound of the id being pushed right now; ~0 when idle
+			std::atomic<bool> retired;    // producer thread has exited
+			char padding1[ 64 ];
+			ring *next;
+			event events[ capacity ];
+		};
+#endif
 	}
-}
 
-bool fserve( unsigned port, const std::string &mask, const std::string &path ) {
-	return create( port, mask, file_reader, get_app_folder() + path );
-}
+	namespace
+	{
+		using namespace tracey::detail;
 
-#undef INIT
-#undef SOCKET
-#undef ACCEPT
-#undef CONNECT
-#undef CLOSE
-#undef RECV
-#undef READ
-#undef SELECT
-#undef SEND
-#undef WRITE
-#undef GETSOCKOPT
-#undef SETSOCKOPT
+		typedef std::vector< const leak *, arena_allocator< const leak * > > leaks;
 
-#undef BIND
-#undef LISTEN
-#undef SHUTDOWN
-#undef SHUTDOWN_R
-#undef SHUTDOWN_W
+		// address and id of an allocation. once its record is freed or reallocated, the pair matches no record anymore.
+		typedef std::pair< const void *, size_t > stamp;
+		typedef std::vector< stamp, arena_allocator< stamp > > stamps;
 
-/*/ 1XX informational
-/*/ const httpcode SHUTDOWN = { 0, "Shutdown requested" };
-/*/ 1XX informational
-/*/ const httpcode CONTINUE = { 100, "The request can be continued." }; /*/
-/*/ const httpcode SWITCH_PROTOCOLS = { 101, "The server has switched protocols in an upgrade header." };
-/*/ 2XX success
-/*/ const httpcode OK = { 200, "The request completed successfully." }; /*/
-/*/ const httpcode CREATED = { 201, "The request has been fulfilled and resulted in the creation of a new resource." }; /*/
-/*/ const httpcode ACCEPTED = { 202, "The request has been accepted for processing, but the processing has not been completed." }; /*/
-/*/ const httpcode PARTIAL = { 203, "The returned meta information in the entity-header is not the definitive set available from the originating server." }; /*/
-/*/ const httpcode NO_CONTENT = { 204, "The server has fulfilled the request, but there is no new information to send back." }; /*/
-/*/ const httpcode RESET_CONTENT = { 205, "The request has been completed, and the client program should reset the document view that caused the request to be sent to allow the user to easily initiate another input action." }; /*/
-/*/ const httpcode PARTIAL_CONTENT = { 206, "The server has fulfilled the partial GET request for the resource." }; /*/
-/*/ const httpcode WEBDAV_MULTI_STATUS = { 207, "During a World Wide Web Distributed Authoring and Versioning (WebDAV) operation, this indicates multiple status const httpcodes for a single response. The response body contains Extensible Markup Language (XML) that describes the status const httpcodes. For more information, see HTTP Extensions for Distributed Authoring." };
-/*/ 3XX redirection
-/*/ const httpcode AMBIGUOUS = { 300, "The requested resource is available at one or more locations." }; /*/
-/*/ const httpcode MOVED = { 301, "The requested resource has been assigned to a new permanent Uniform Resource Identifier (URI), and any future references to this resource should be done using one of the returned URIs." }; /*/
-/*/ const httpcode REDIRECT = { 302, "The requested resource resides temporarily under a different URI." }; /*/
-/*/ const httpcode REDIRECT_METHOD = { 303, "The response to the request can be found under a different URI and should be retrieved using a GET HTTP verb on that resource." }; /*/
-/*/ const httpcode NOT_MODIFIED = { 304, "The requested resource has not been modified." }; /*/
-/*/ const httpcode USE_PROXY = { 305, "The requested resource must be accessed through the proxy given by the location field." }; /*/
-/*/ const httpcode REDIRECT_KEEP_VERB = { 307, "The redirected request keeps the same HTTP verb. HTTP/1.1 behavior." };
-/*/ 4XX client's fault
-/*/ const httpcode BAD_REQUEST = { 400, "The request could not be processed by the server due to invalid syntax." }; /*/
-/*/ const httpcode DENIED = { 401, "The requested resource requires user authentication." }; /*/
-/*/ const httpcode PAYMENT_REQ = { 402, "Not implemented in the HTTP protocol." }; /*/
-/*/ const httpcode FORBIDDEN = { 403, "The server understood the request, but cannot fulfill it." }; /*/
-/*/ const httpcode NOT_FOUND = { 404, "The server has not found anything that matches the requested URI." }; /*/
-/*/ const httpcode BAD_METHOD = { 405, "The HTTP verb used is not allowed." }; /*/
-/*/ const httpcode NONE_ACCEPTABLE = { 406, "No responses acceptable to the client were found." }; /*/
-/*/ const httpcode PROXY_AUTH_REQ = { 407, "Proxy authentication required." }; /*/
-/*/ const httpcode REQUEST_TIMEOUT = { 408, "The server timed out waiting for the request." }; /*/
-/*/ const httpcode CONFLICT = { 409, "The request could not be completed due to a conflict with the current state of the resource. The user should resubmit with more information." }; /*/
-/*/ const httpcode GONE = { 410, "The requested resource is no longer available at the server, and no forwarding address is known." }; /*/
-/*/ const httpcode LENGTH_REQUIRED = { 411, "The server cannot accept the request without a defined content length." }; /*/
-/*/ const httpcode PRECOND_FAILED = { 412, "The precondition given in one or more of the request header fields evaluated to false when it was tested on the server." }; /*/
-/*/ const httpcode REQUEST_TOO_LARGE = { 413, "The server cannot process the request because the request entity is larger than the server is able to process." }; /*/
-/*/ const httpcode URI_TOO_LONG = { 414, "The server cannot service the request because the request URI is longer than the server can interpret." }; /*/
-/*/ const httpcode UNSUPPORTED_MEDIA = { 415, "The server cannot service the request because the entity of the request is in a format not supported by the requested resource for the requested method." }; /*/
-/*/ const httpcode RETRY_WITH = { 449, "The request should be retried after doing the appropriate action." };
-/*/ 5XX server's fault
-/*/ const httpcode SERVER_ERROR = { 500, "The server encountered an unexpected condition that prevented it from fulfilling the request." }; /*/
-/*/ const httpcode NOT_SUPPORTED = { 501, "The server does not support the functionality required to fulfill the request." }; /*/
-/*/ const httpcode BAD_GATEWAY = { 502, "The server, while acting as a gateway or proxy, received an invalid response from the upstream server it accessed in attempting to fulfill the request." }; /*/
-/*/ const httpcode SERVICE_UNAVAIL = { 503, "The service is temporarily overloaded." }; /*/
-/*/ const httpcode GATEWAY_TIMEOUT = { 504, "The request was timed out waiting for a gateway." }; /*/
-/*/ const httpcode VERSION_NOT_SUP = { 505, "The server does not support the HTTP protocol version that was used in the request message." };
+		// set while a thread runs inside tracey, so tracey's own allocations are not tracked
+		static $tls(bool) acquired = false;
 
-}
+		// registry is ready once its shards (and their locks) are constructed
+		volatile bool ready = false;
 
+		// hard on/off switch
+		static const    bool kTraceyEnabledHard = kTraceyEnabled;
+		// soft on/off switch
+		static volatile bool kTraceyEnabledSoft = true;
 
-#endif
+		// tracey::counter state of a thread: totals of its allocations and frees while counters are active, the number of
+		// active counters, and how many of them are counting-only (allocations are counted, and neither captured nor tracked)
+		static $tls(tracey::counter::totals) tally;
+		static $tls(unsigned) counters = 0;
+		static $tls(unsigned) counting = 0;
+		// counting-only allocations find no record when freed. frees of a thread that is counting are taken for those,
+		// and the blocks still allocated when it stops counting are left in escaped, to excuse as many frees of the same
+		// thread later on. frees of those blocks on other threads are reported as wild pointers.
+		static $tls(size_t) counted_blocks = 0;
+		static $tls(size_t) unmatched_frees = 0;
+		static $tls(size_t) escaped = 0;
+
+		// whether a free that finds no record belongs to a counting-only allocation
+		bool counted_free() {
+			if( counting ) {
+				unmatched_frees++;
+				return true;
+			}
+			if( escaped ) {
+				escaped--;
+				return true;
+			}
+			return false;
+		}
 
-// checks: todo
-// if /MD or /MDd and kTraceyReportWildPointers warn user "not a good idea"
-#if kTraceyHookLegacyCRT
-	$warning( "<tracey/tracey.cpp> says: kTraceyHookLegacyCRT option ignored. CRT hooking not supported on this platform.")
-#   undef  kTraceyHookLegacyCRT
-#   define kTraceyHookLegacyCRT 0
+		// counts an allocation or free of calling thread, before tracey admits it, so counters work while tracey is
+		// disabled too. returns whether a counting-only allocation must be left untracked.
+		bool tallied( size_t size ) {
+			if( size == ~size_t( 0 ) || size == 0 ) {
+				tally.frees++;
+				return false;
+			}
+			tally.allocations++;
+			tally.allocated += size;
+			return counting != 0;
+		}
+
+		// records older than last clear() stay tracked, so their frees are still matched, but they are left out of stats and reports
+		bool in_epoch( const leak &L ) {
+			return L.id >= timestamp_id;
+		}
+
+		// a slice of the registry. every address belongs to exactly one shard, and every shard has its own lock.
+		struct shard {
+			lock_t mutex;
+			table< leak > leaks;
+			// records created in current epoch. stale stamps are swept every time the journal doubles. empty until the first clear().
+			// bounded: an epoch that keeps over half of journal_cap records of a shard live stops its journal, and the
+			// shard is walked in full instead. capacity is reserved up front and kept across epochs, so stamps never allocate.
+			enum { journal_cap = 4096 };
+			stamps journal;
+			size_t journal_limit;
+			bool journal_full;
+#if kTraceyAsyncTracking
+			// addresses whose newest applied event is a deallocation (id only)
+			table< leak > freed;
+#endif
+#if kTraceyInbandHeaders
+			// tracked in-band headers of this shard
+			header *inband;
+			size_t inband_count;
 #endif
 
-namespace tracey
-{
-	static void webmain( void * );
-	static void hotkeymain( void * );
+			// keep neighbour shards (and their locks) in different cache lines
+			char padding[ 64 ];
 
-	typedef heal::sfstring string;
-	typedef heal::sfstrings strings;
+			void journal_add( const void *addr, size_t id ) {
+				if( !timestamp_id || journal_full ) {
+					return;
+				}
+				if( journal.size() >= journal_limit ) {
+					size_t kept = 0;
+					for( size_t i = 0; i < journal.size(); ++i ) {
+						leak *L = leaks.find( journal[i].first );
+						if( L && L->id == journal[i].second ) journal[ kept++ ] = journal[i];
+					}
+					journal.resize( kept );
+					if( kept * 2 > journal_cap ) {
+						journal.clear();
+						journal_full = true;
+						return;
+					}
+					journal_limit = std::max( size_t( 64 ), kept * 2 );
+				}
+				if( journal.capacity() < journal_limit ) {
+					journal.reserve( journal_limit );
+				}
+				journal.push_back( stamp( addr, id ) );
+			}
 
-	std::string human( size_t bytes ) {
-		/**/ if( bytes >= 1024 * 1024 * 1024 ) return tracey::string("\1 GB", bytes / (1024 * 1024 * 1024));
-		else if( bytes >=   16 * 1024 * 1024 ) return tracey::string("\1 MB", bytes / (       1024 * 1024));
-		else if( bytes >=          16 * 1024 ) return tracey::string("\1 KB", bytes / (              1024));
-		else                                   return tracey::string("\1 bytes", bytes );
-	}
+			void journal_reset() {
+				journal.clear();
+				journal_limit = 64;
+				journal_full = false;
+			}
+		};
 
-	struct branch {
-		size_t hits;
-		size_t size;
-		branch() : hits(0), size(0) {
-		}
-		branch( const branch &other ) {
-			operator=( other );
-		}
-		branch &operator =( const branch &other ) {
-			if( this != &other ) {
-				hits = other.hits;
-				size = other.size;
+		// report output: text is gathered in a fixed block and handed to a writer every time the block fills up,
+		// so reports of any size are emitted with bounded memory. once the writer fails, further text is dropped.
+		class sink
+		{
+			public:
+
+			sink( tracey::writer fn, void *user ) : fn( fn ), user( user ), len( 0 ), ok( true )
+			{}
+			~sink() {
+				flush();
+			}
+
+			void write( const char *data, size_t n ) {
+				while( n && ok ) {
+					if( !len && n >= sizeof(buf) ) {
+						ok = fn( data, n, user ) != 0;
+						return;
+					}
+					size_t chunk = n < sizeof(buf) - len ? n : sizeof(buf) - len;
+					std::memcpy( buf + len, data, chunk );
+					len += chunk, data += chunk, n -= chunk;
+					if( len == sizeof(buf) ) flush();
+				}
 			}
-			return *this;
+			void write( const std::string &text ) {
+				write( text.data(), text.size() );
+			}
+			bool flush() {
+				if( len && ok ) ok = fn( buf, len, user ) != 0;
+				len = 0;
+				return ok;
+			}
+
+			private:
+
+			tracey::writer fn;
+			void *user;
+			size_t len;
+			bool ok;
+			char buf[ 16 * 1024 ];
+
+			sink( const sink & );
+			sink &operator=( const sink & );
+		};
+
+		// writers for report files, user streams and file descriptors (see tracey::report())
+		int write_file( const char *data, size_t len, void *user ) {
+			return kTraceyfPrintf( (kTraceyfFile *)user, "%.*s", int( len ), data ) == int( len );
 		}
-		branch &operator +=( const branch &other ) {
-			this->size += /*(other.hits ? other.hits : 1) **/ other.size;
-			return *this;
+		int write_stream( const char *data, size_t len, void *user ) {
+			return std::fwrite( data, 1, len, (FILE *)user ) == len;
 		}
-		bool operator<( const double t ) const {
-			return size < t;
+		int write_fd( const char *data, size_t len, void *user ) {
+			int fd = *(int *)user;
+			while( len ) {
+				$windows( int n = _write( fd, data, unsigned( len ) ); )
+				$welse( ssize_t n = ::write( fd, data, len ); )
+				if( n < 0 && $welse( errno == EINTR ) $windows( false ) ) continue;
+				if( n <= 0 ) return 0;
+				data += n, len -= size_t( n );
+			}
+			return 1;
 		}
 
-		std::string str( double total ) const {
-			tracey::string os;
-			int pct = int((size * 100.0) / total);
-			/**/ if( pct >= 100 ) os << tracey::string(   "\1%", pct ) << " .. " << tracey::human( size );
-			else if( pct >=  10 ) os << tracey::string(  "0\1%", pct ) << " .. " << tracey::human( size );
-			else                  os << tracey::string( "00\1%", pct ) << " .. " << tracey::human( size );
+		// calling-context trie of a report: every node is a frame reached through the frames above it.
+		// nodes are stored in one array and only appended, so parents always come before their children and
+		// roll-ups are a single reverse scan. children are linked lists (first child, next sibling), and nodes
+		// are found by (parent, frame) through an open-addressing index.
+		class trie
+		{
+			public:
 
-			if( hits > 1 ) os << " ; " << hits << " hits";
-			return os;
-		}
-	};
-}
+			enum { root = 0, none = ~0u };
 
-namespace tracey {
+			struct node {
+				void *frame;
+				unsigned parent, first_child, next_sibling;
+				size_t size, hits;  // own weight while building; own plus descendants after rollup()
+			};
 
-	//#include <map>
-	//#include <iostream>
+			std::vector< node, arena_allocator< node > > nodes;
 
-	// tree class
-	// [] is read-only
-	// () is read-writeable (so is <<)
-	typedef void *K;
-	typedef branch V;
-	typedef oak::tree<K,V> tree;
-
-	// for tree walking
-	struct chopper {
-		bool operator()( tracey::tree &tree, tracey::tree::iterator &it ) const {
-			if( it->second.get() < kTraceyTruncateBranchesSmallerThan ) {
-				tree.erase( it->first );
-				return false;
-			} else {
-				return true;
+			trie() {
+				node r = { 0, none, none, none, 0, 0 };
+				nodes.push_back( r );
+				index.assign( 64, none );
 			}
-		}
-	};
 
-	template<typename U>
-	std::string print( const tree &self, double total, const tracey::string &fmt1234, const tracey::string &sorted_by, bool reversed, const std::map<K,U> &tmap, unsigned depth ) {
-		std::map<std::string,tracey::strings> list;
-		std::string tabs( depth, kTraceyCharTab[0] );
-		if( !tmap.empty() ) {
-			for( tree::const_iterator it = self.begin(), end = self.end(); it != end; ++it  ) {
-				tracey::string key( sorted_by, tmap.find( it->first )->second, it->second.get().str(total), tabs, self.size() );
-				tracey::string value( fmt1234, tmap.find( it->first )->second, it->second.get().str(total), tabs, self.size() );
-				list[ key ].push_back( value );
-				list[ key ].push_back( print( it->second, total, fmt1234, sorted_by, reversed, tmap, depth + 1 ) );
-			}
-		} else {
-			for( tree::const_iterator it = self.begin(), end = self.end(); it != end; ++it  ) {
-				tracey::string key( sorted_by, it->first, it->second.get().str(total), tabs, self.size() );
-				tracey::string value( fmt1234, it->first, it->second.get().str(total), tabs, self.size() );
-				list[ key ].push_back( value );
-				list[ key ].push_back( print( it->second, total, fmt1234, sorted_by, reversed, tmap, depth + 1 ) );
+			// child of parent for given frame, added if new
+			unsigned child( unsigned parent, void *frame ) {
+				size_t mask = index.size() - 1;
+				for( size_t slot = hash( parent, frame ) & mask; ; slot = ( slot + 1 ) & mask ) {
+					unsigned id = index[ slot ];
+					if( id == none ) {
+						id = unsigned( nodes.size() );
+						node n = { frame, parent, none, nodes[ parent ].first_child, 0, 0 };
+						nodes.push_back( n );
+						nodes[ parent ].first_child = id;
+						index[ slot ] = id;
+						if( nodes.size() * 2 > index.size() ) grow();
+						return id;
+					}
+					if( nodes[ id ].parent == parent && nodes[ id ].frame == frame ) {
+						return id;
+					}
+				}
 			}
-		}
-		std::string out;
-		if( !reversed ) {
-			for( std::map<std::string,tracey::strings>::const_iterator it = list.begin(), end = list.end(); it != end; ++it ) {
-				out += it->second.flat();
+
+			// adds every node's weight to its ancestors
+			void rollup() {
+				for( size_t i = nodes.size(); i-- > 1; ) {
+					node &parent = nodes[ nodes[i].parent ];
+					parent.size += nodes[i].size;
+					parent.hits += nodes[i].hits;
+				}
 			}
-		} else {
-			for( std::map<std::string,tracey::strings>::const_reverse_iterator it = list.rbegin(), end = list.rend(); it != end; ++it ) {
-				out += it->second.flat();
+
+			size_t num_children( unsigned id ) const {
+				size_t n = 0;
+				for( unsigned c = nodes[ id ].first_child; c != none; c = nodes[ c ].next_sibling ) ++n;
+				return n;
 			}
-		}
-		return out;
-	}
 
-	template<typename U>
-	std::string print( const tree &self, double total, const std::map<K,U> &tmap, const tracey::string &format = "{tabs}[{size}] {key} ({value})\n", const tracey::string &sorted_by = "{key}", bool reversed = false ) {
-		tracey::string fmt = format
-		.replace("{key}",   "\1")
-		.replace("{value}", "\2")
-		.replace("{tabs}",  "\3")
-		.replace("{size}",  "\4");
-		tracey::string sort = sorted_by
-		.replace("{key}",   "\1")
-		.replace("{value}", "\2")
-		.replace("{tabs}",  "\3")
-		.replace("{size}",  "\4");
-		return print( self, total, fmt, sort, reversed, tmap, 0 );
-	}
+			private:
 
-	std::string print( const tree &self, double total, const tracey::string &format = "{tabs}[{size}] {key} ({value})\n", const tracey::string &sorted_by = "{key}", bool reversed = false ) {
-		std::map<K, K> dummy;
-		return print( self, total, dummy, format, sorted_by, reversed );
-	}
+			std::vector< unsigned, arena_allocator< unsigned > > index;
 
-	// callstack, demangle, lookup
-	using namespace heal;
-}
+			static size_t hash( unsigned parent, void *frame ) {
+				uint64_t h = ( uint64_t( uintptr_t( frame ) ) ^ ( parent * 0x9e3779b97f4a7c15ULL ) ) * 0xbf58476d1ce4e5b9ULL;
+				return size_t( h ^ ( h >> 31 ) );
+			}
 
-namespace tracey
-{
-	namespace
-	{
-		volatile size_t timestamp_id = 0;
-		struct stats_t {
-			size_t usage, usage_peak, num_leaks, leak_peak, overhead;
-			stats_t() : usage(0), usage_peak(0), num_leaks(0), leak_peak(0), overhead(0) {}
-			std::string str() const {
-				return tracey::string("highest peak: \1 total, \2 greatest peak // \3 allocs in use: \4 + overhead: \5 = total: \6",
-									human(usage_peak), human(leak_peak), num_leaks, human(usage), human(overhead), human( usage + overhead ) );
+			void grow() {
+				index.assign( index.size() * 2, none );
+				size_t mask = index.size() - 1;
+				for( unsigned id = 1; id < nodes.size(); ++id ) {
+					size_t slot = hash( nodes[ id ].parent, nodes[ id ].frame ) & mask;
+					while( index[ slot ] != none ) slot = ( slot + 1 ) & mask;
+					index[ slot ] = id;
+				}
 			}
-		} stats;
+		};
 
-		size_t create_id() {
-			static size_t id = 0;
-			return ++id;
-		}
+		// symbols of a report by frame
+		typedef std::map< void *, std::string, std::less< void * >, arena_allocator< std::pair< void * const, std::string > > > symbol_table;
 
-		bool view_report( const std::string &html ) {
-			$windows( return std::system( tracey::string("start \1", html).c_str() ), true );
-			$apple( return std::system( tracey::string("open \1", html).c_str() ), true );
-			$linux( return std::system( tracey::string("xdg-open \1", html).c_str() ), true );
-			return false;
-		}
+		// orders siblings of a report: heaviest first, then by name
+		struct heavier {
+			const trie &calls;
+			const symbol_table &symbols;
+			heavier( const trie &calls, const symbol_table &symbols ) : calls( calls ), symbols( symbols )
+			{}
+			bool operator()( unsigned a, unsigned b ) const {
+				const trie::node &x = calls.nodes[a], &y = calls.nodes[b];
+				if( x.size != y.size ) return x.size > y.size;
+				return symbols.find( x.frame )->second < symbols.find( y.frame )->second;
+			}
+		};
 
-		std::string get_temp_pathfile() {
-			$windows(
-				std::string path = std::string( std::getenv("TEMP") ? std::getenv("TEMP") : "." ) + std::tmpnam(0);
-				while( path.size() && path.at( path.size() - 1 ) == '.' ) path.resize( path.size() - 1 );
-				return path;
-			)
-			$welse(
-				return std::string() + std::tmpnam(0);
-			)
+		// writes a rolled-up trie depth-first as "{tabs}[{siblings}] ({weight}) {symbol}" lines.
+		// branches under kTraceyTruncateBranchesSmallerThan percent of total are left out.
+		void print( sink &out, const trie &calls, double total, const symbol_table &symbols ) {
+			std::vector< std::pair< unsigned, unsigned > > pending; // node, depth
+			std::vector< unsigned > children;
+			std::string line;
+			pending.push_back( std::make_pair( unsigned( trie::root ), 0u ) );
+			while( !pending.empty() ) {
+				unsigned id = pending.back().first, depth = pending.back().second;
+				pending.pop_back();
+				if( id != trie::root ) {
+					const trie::node &n = calls.nodes[ id ];
+					tracey::branch b;
+					b.size = n.size;
+					b.hits = n.hits;
+					line.assign( depth - 1, kTraceyCharTab[0] );
+					line += tracey::string( "[\1] (\2) \3" kTraceyCharLinefeed, calls.num_children( n.parent ), b.str( total ), symbols.find( n.frame )->second );
+					out.write( line );
+				}
+				children.clear();
+				for( unsigned c = calls.nodes[ id ].first_child; c != trie::none; c = calls.nodes[ c ].next_sibling ) {
+					if( kTraceyTruncateBranchesSmallerThan > 0 && total > 0 && calls.nodes[ c ].size * 100.0 / total < kTraceyTruncateBranchesSmallerThan ) continue;
+					children.push_back( c );
+				}
+				std::sort( children.begin(), children.end(), heavier( calls, symbols ) );
+				for( size_t i = children.size(); i-- > 0; ) {
+					pending.push_back( std::make_pair( children[i], depth + 1 ) );
+				}
+			}
 		}
-	}
 
-	namespace detail
-	{
-		struct leak {
-			size_t id, size;
-			const void *addr;
-			tracey::callstack cs;
+		// heap snapshots (see tracey::dump): live allocations merged by callstack, and frames stored as offsets into the
+		// modules that contain them, along with the build-ids of those modules, so they can be symbolized offline.
+		// layout, in host byte order:
+		//   magic[8] version:u32 pointer_size:u32 stats:u64[6]
+		//   num_modules:u32 { path:str build_id:str bias:u64 }
+		//   num_stacks:u32 { bytes:u64 count:u64 depth:u32 { module:u32 offset:u64 } }
+		// where str is length:u32 plus bytes, and frames out of any module have module ~0 and their address as offset.
+		namespace snapshot {
+
+			const char magic[] = "tracey\1\0";
+			enum { version = 1, unknown = ~0u };
+
+			struct module {
+				std::string path, build_id;
+				uintptr_t bias;
+			};
 
-			leak() : size(0), id(0), addr(0)
-			{}
+			// address range of a loaded segment
+			struct segment {
+				uintptr_t lo, hi;
+				unsigned module;
+				bool operator<( const segment &other ) const {
+					return lo < other.lo;
+				}
+			};
 
-			void wipe() {
-				id = create_id();
-				cs = tracey::callstack();
-				size = 0;
-				addr = 0;
-			}
+			struct frame {
+				unsigned module;
+				uint64_t offset;
+			};
 
-			~leak() {
-				wipe();
-			}
-		};
-	}
+			struct stack {
+				uint64_t bytes, count;
+				std::vector<frame> frames;
+				bool operator<( const stack &other ) const {
+					return bytes > other.bytes;
+				}
+			};
 
-	namespace
-	{
-		using namespace tracey::detail;
+			struct modules {
+				std::vector<module> list;
+				std::vector<segment> segments;
 
-		typedef std::vector< const leak * > leaks;
+				// modules are listed from the loader, so build-ids are read from memory and no file is opened
+				modules() {
+					$linux({
+						dl_iterate_phdr( add, this );
+					})
+					std::sort( segments.begin(), segments.end() );
+				}
+
+				$linux(
+				static int add( struct dl_phdr_info *info, size_t, void *data ) {
+					modules &self = *(modules *)data;
+					module m;
+					m.path = info->dlpi_name ? info->dlpi_name : "";
+					m.bias = info->dlpi_addr;
+					if( m.path.empty() ) {
+						char exe[ 4096 ];
+						ssize_t len = readlink( "/proc/self/exe", exe, sizeof(exe) - 1 );
+						if( len > 0 ) m.path.assign( exe, len );
+					}
+					for( int i = 0; i < info->dlpi_phnum; ++i ) {
+						const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+						if( ph.p_type == PT_LOAD ) {
+							segment s = { info->dlpi_addr + ph.p_vaddr, info->dlpi_addr + ph.p_vaddr + ph.p_memsz, unsigned( self.list.size() ) };
+							self.segments.push_back( s );
+						}
+						if( ph.p_type != PT_NOTE ) continue;
+						for( const char *p = (const char *)( info->dlpi_addr + ph.p_vaddr ), *end = p + ph.p_memsz; size_t( end - p ) >= sizeof(ElfW(Nhdr)); ) {
+							const ElfW(Nhdr) &note = *(const ElfW(Nhdr) *)p;
+							const char *name = p + sizeof(note), *desc = name + ( ( note.n_namesz + 3 ) & ~3u );
+							p = desc + ( ( note.n_descsz + 3 ) & ~3u );
+							if( p > end ) break;
+							if( note.n_type == NT_GNU_BUILD_ID && note.n_namesz == 4 && !std::memcmp( name, "GNU", 4 ) ) {
+								static const char hex[] = "0123456789abcdef";
+								for( unsigned j = 0; j < note.n_descsz; ++j ) {
+									m.build_id += hex[ uint8_t( desc[j] ) >> 4 ];
+									m.build_id += hex[ uint8_t( desc[j] ) & 15 ];
+								}
+							}
+						}
+					}
+					self.list.push_back( m );
+					return 0;
+				})
+
+				frame locate( void *addr ) const {
+					segment key = { uintptr_t( addr ), 0, 0 };
+					std::vector<segment>::const_iterator it = std::upper_bound( segments.begin(), segments.end(), key );
+					if( it != segments.begin() && uintptr_t( addr ) < (--it)->hi ) {
+						frame f = { it->module, uint64_t( uintptr_t( addr ) - list[ it->module ].bias ) };
+						return f;
+					}
+					frame f = { unknown, uint64_t( uintptr_t( addr ) ) };
+					return f;
+				}
+			};
 
-		// recursive mutex
-		std::recursive_mutex *mutex = 0;
+			struct writer {
+				std::string data;
+				void u32( uint32_t v ) { data.append( (const char *)&v, sizeof(v) ); }
+				void u64( uint64_t v ) { data.append( (const char *)&v, sizeof(v) ); }
+				void str( const std::string &s ) { u32( uint32_t( s.size() ) ); data += s; }
+			};
 
-		// hard on/off switch
-		static const    bool kTraceyEnabledHard = kTraceyEnabled;
-		// soft on/off switch
-		static volatile bool kTraceyEnabledSoft = true;
+			struct reader {
+				const std::string &data;
+				size_t pos;
+				bool ok;
+				reader( const std::string &data ) : data( data ), pos( 0 ), ok( true )
+				{}
+				void raw( void *out, size_t len ) {
+					ok = ok && len <= data.size() - pos;
+					if( ok ) std::memcpy( out, data.data() + pos, len ), pos += len;
+					else std::memset( out, 0, len );
+				}
+				uint32_t u32() { uint32_t v; raw( &v, sizeof(v) ); return v; }
+				uint64_t u64() { uint64_t v; raw( &v, sizeof(v) ); return v; }
+				std::string str() {
+					uint32_t len = u32();
+					ok = ok && len <= data.size() - pos;
+					if( !ok ) return std::string();
+					pos += len;
+					return data.substr( pos - len, len );
+				}
+			};
+		}
 
-		class container : public std::map< const void *, leak, std::less< const void * > > //, tracey::malloc_allocator< std::pair< const void *, leak * > > >
+		class container
 		{
 			public:
 
+			enum { num_shards = kTraceyRegistryShards > 0 ? kTraceyRegistryShards : 1 };
+			shard shards[ num_shards ];
+			mutable depot stacks;
+
+#if kTraceyAsyncTracking
+			// async tracking: every thread queues its events into its own ring, and rings are applied in batches.
+			// events of different threads may be applied out of order, so every address keeps the id of its newest
+			// event: either a record (allocation) or a tombstone (deallocation). older events are stale and ignored.
+			std::mutex rings_mutex, drain_mutex, wake_mutex;
+			std::condition_variable wake;
+			ring *rings;
+			bool consumer_running;
+			size_t applied;             // every event with a lower id has been applied
+#endif
+
 			container()
 			{
-				 mutex = new std::recursive_mutex();
+				 for( unsigned i = 0; i < num_shards; ++i ) {
+					shards[i].journal_reset();
+				 }
+#if kTraceyAsyncTracking
+				 rings = 0;
+				 consumer_running = false;
+				 applied = 0;
+#endif
+#if kTraceyInbandHeaders
+				 for( unsigned i = 0; i < num_shards; ++i ) {
+					shards[i].inband = 0;
+					shards[i].inband_count = 0;
+				 }
+#endif
+				 ready = true;
 			}
 
 			~container() {
-				mutex = 0;
+				ready = false;
+				sync();
 
 				if( kTraceyReportOnExit && kTraceyEnabledSoft ) {
 					view_report( _report() );
@@ -3235,35 +5637,472 @@ namespace tracey
 				kTraceyDie( __LINE__ );
 			}
 
-			void _clear() {
+			// every shard writes its own lane of stats
+			unsigned lane_of( const shard &sh ) const {
+				return unsigned( &sh - shards );
+			}
+
+			// addresses are hashed so neighbour allocations spread across shards
+			shard &shard_of( const void *ptr ) {
+				size_t hash = size_t( ptr ) >> 4;
+				hash ^= hash >> 16;
+				hash *= 0x45d9f3b;
+				hash ^= hash >> 16;
+				return shards[ hash % num_shards ];
+			}
+
+			// shards are always locked in the same order, so whole-registry operations cannot deadlock
+			void lock_all() {
+				for( unsigned i = 0; i < num_shards; ++i ) {
+					shards[i].mutex.lock();
+				}
+			}
+			void unlock_all() {
+				for( unsigned i = num_shards; i-- > 0; ) {
+					shards[i].mutex.unlock();
+				}
+			}
+
+			size_t size() const {
+				size_t n = 0;
+				for( unsigned i = 0; i < num_shards; ++i ) {
+					n += shards[i].leaks.size();
+#if kTraceyInbandHeaders
+					n += shards[i].inband_count;
+#endif
+				}
+				return n;
+			}
+
+			// takes every lock of tracey, in this order: unwinder, event queues, shards, callstacks and arena.
+			// held across fork() with forked reports on (see pthread_atfork in init), so a child never inherits state another thread was changing.
+			// the symbolizer is not held, as it may be busy for long; children reset it instead (see heal::forked_symbolizer).
+			void freeze() {
+				heal::lock_unwinder();
+#if kTraceyAsyncTracking
+				drain_mutex.lock();
+				rings_mutex.lock();
+#endif
+				lock_all();
+				stacks.lock();
+				metadata().lock();
+			}
+			void thaw() {
+				metadata().unlock();
+				stacks.unlock();
+				unlock_all();
+#if kTraceyAsyncTracking
+				rings_mutex.unlock();
+				drain_mutex.unlock();
+#endif
+				heal::unlock_unwinder();
+			}
+
+			// applies all queued events, so the registry is exact. no-op unless async tracking is enabled.
+			void sync() {
+#if kTraceyAsyncTracking
+				drain_mutex.lock();
+				drain();
+				drain_mutex.unlock();
+#endif
+			}
+
+#if kTraceyAsyncTracking
+			// creates the ring of calling thread. the first one also starts the consumer thread.
+			ring *attach() {
+				ring *r = (ring *)metadata().allocate( sizeof(ring) );
+				r->head = 0;
+				r->tail = 0;
+				r->claim = ~size_t(0);
+				r->retired = false;
+
+				rings_mutex.lock();
+				r->next = rings;
+				rings = r;
+				if( !consumer_running ) {
+					consumer_running = true;
+					std::thread( consumer, this ).detach();
+				}
+				rings_mutex.unlock();
+				return r;
+			}
 
-				for( iterator it = this->begin(), end = this->end(); it != end; ++it ) {
-					it->second.wipe();
+			// flushes the ring of an exiting thread. the ring itself is reclaimed by next drain.
+			void detach( ring *r ) {
+				drain_mutex.lock();
+				drain();
+				r->retired = true;
+				drain_mutex.unlock();
+			}
+
+			// queues an event into given ring, and returns its id. threads with no ring (exited ones) apply theirs in place.
+			size_t post( ring *r, const void *addr, size_t size, unsigned stack, float weight ) {
+				if( r ) {
+					return push( *r, addr, size, stack, weight );
+				}
+				// ids are taken under the drain lock too, so no drain can see this id missing from the rings
+				drain_mutex.lock();
+				event e = { addr, size, create_id(), stack, weight };
+				apply( e );
+				drain_mutex.unlock();
+				return e.id;
+			}
+
+			// producer side. waits only if the ring is full.
+			size_t push( ring &r, const void *addr, size_t size, unsigned stack, float weight ) {
+				size_t tail = r.tail.load( std::memory_order_relaxed );
+				if( tail - r.head.load( std::memory_order_acquire ) == ring::capacity / 2 ) {
+					wake.notify_one();
+				}
+				while( tail - r.head.load( std::memory_order_acquire ) == ring::capacity ) {
+					wake.notify_one();
+					std::this_thread::yield();
+				}
+
+				// the claim is published before taking an id, so drain() never assumes this event has been pushed
+				r.claim.store( last_id.load() );
+				event &e = r.events[ tail & ring::mask ];
+				e.addr = addr;
+				e.size = size;
+				e.stack = stack;
+				e.weight = weight;
+				size_t id = e.id = create_id();
+				r.tail.store( tail + 1, std::memory_order_release );
+				r.claim.store( ~size_t(0) );
+				return id;
+			}
+
+			static void consumer( container *self ) {
+				acquired = true;
+				for(;;) {
+					{
+						std::unique_lock<std::mutex> lock( self->wake_mutex );
+						self->wake.wait_for( lock, std::chrono::milliseconds( 10 ) );
+					}
+					self->sync();
+				}
+			}
+
+			// drainer side. drain_mutex must be held.
+			void drain() {
+				// ids below the watermark are not being pushed by anyone, so they are all in the rings by now
+				size_t watermark = last_id.load();
+				rings_mutex.lock();
+				ring *list = rings;
+				rings_mutex.unlock();
+				for( ring *r = list; r; r = r->next ) {
+					size_t claim = r->claim.load();
+					if( claim < watermark ) watermark = claim;
+				}
+
+				for( ring *r = list; r; r = r->next ) {
+					size_t head = r->head.load( std::memory_order_relaxed ), tail = r->tail.load( std::memory_order_acquire );
+					for( ; head != tail; ++head ) {
+						apply( r->events[ head & ring::mask ] );
+					}
+					r->head.store( head, std::memory_order_release );
+				}
+				applied = watermark;
+
+				// tombstones only reject older events, and every event below the watermark has been applied.
+				// erasing moves (or frees) other slots, so expired addresses are copied out before any is erased.
+				leaks old;
+				std::vector< const void *, arena_allocator< const void * > > expired;
+				for( unsigned i = 0; i < num_shards; ++i ) {
+					shard &sh = shards[i];
+					sh.mutex.lock();
+					if( sh.freed.size() ) {
+						old.clear();
+						expired.clear();
+						sh.freed.sorted( old );
+						for( leaks::const_iterator it = old.begin(), end = old.end(); it != end; ++it ) {
+							if( (*it)->id < watermark ) expired.push_back( (*it)->addr );
+						}
+						for( size_t j = 0; j < expired.size(); ++j ) {
+							if( leak *T = sh.freed.find( expired[j] ) ) sh.freed.erase( T );
+						}
+					}
+					sh.mutex.unlock();
+				}
+
+				// rings of exited threads are empty by now
+				rings_mutex.lock();
+				for( ring **link = &rings; *link; ) {
+					ring *r = *link;
+					if( r->retired ) {
+						*link = r->next;
+						metadata().deallocate( r, sizeof(ring) );
+					} else {
+						link = &r->next;
+					}
+				}
+				rings_mutex.unlock();
+			}
+
+			void apply( const event &e ) {
+				shard &sh = shard_of( e.addr );
+				unsigned drop = 0;
+				sh.mutex.lock();
+				leak *L = sh.leaks.find( e.addr );
+				leak *T = sh.freed.find( e.addr );
+				if( e.size ) {
+					if( ( L && L->id > e.id ) || ( T && T->id > e.id ) ) {
+						// already freed (or reallocated) by a newer event
+						drop = e.stack;
+					} else {
+						if( T ) {
+							sh.freed.erase( T );
+						}
+						// a record with an older id was freed by an event that has not been applied yet
+						if( L ) {
+							drop = L->stack;
+							if( in_epoch( *L ) ) stats.sub( lane_of( sh ), L->size, L->weight );
+						}
+						leak &N = L ? *L : sh.leaks.insert( e.addr );
+						N.id = e.id;
+						N.size = e.size;
+						N.stack = e.stack;
+						N.weight = e.weight;
+						if( in_epoch( N ) ) {
+							stats.add( lane_of( sh ), e.size, e.weight );
+							sh.journal_add( e.addr, e.id );
+						}
+					}
+				} else if( !L || L->id < e.id ) {
+					// an older allocation of this address may still be queued, unless the record predates the watermark
+					bool tombstone = !L || L->id >= applied;
+					if( L ) {
+						drop = L->stack;
+						if( in_epoch( *L ) ) stats.sub( lane_of( sh ), L->size, L->weight );
+						sh.leaks.erase( L );
+					}
+					if( tombstone ) {
+						leak &N = T ? *T : sh.freed.insert( e.addr );
+						if( N.id < e.id ) N.id = e.id;
+					}
 				}
+				sh.mutex.unlock();
+				stacks.release( drop );
+			}
+#endif
 
-				this->clear();
+			// starts a new epoch: records so far are kept, but stats and reports only count newer ones from now on.
+			// all shards must be locked.
+			void _clear() {
+				stats.reset();
+				timestamp_id = create_id();
+				for( unsigned i = 0; i < num_shards; ++i ) {
+					shards[i].journal_reset();
+				}
 			}
 
-			leaks collect_leaks( size_t *wasted ) const {
-				leaks list;
+			// records of current epoch. after a clear(), only the journals are walked, so the cost is proportional to the
+			// allocations made since then rather than to the whole registry (unless a journal filled up).
+			leaks collect_leaks( size_t *wasted, size_t *found ) {
+				leaks all, list;
 				*wasted = 0;
-				for( const_iterator it = this->begin(), end = this->end(); it != end; ++it ) {
-					const tracey::detail::leak &L = it->second;
-					if( L.addr && L.size && L.id >= timestamp_id ) {
-						*wasted += L.size;
+				*found = 0;
+				for( unsigned i = 0; i < num_shards; ++i ) {
+					shard &sh = shards[i];
+					if( !timestamp_id || sh.journal_full ) {
+						sh.leaks.sorted( all );
+					} else {
+						for( size_t j = 0; j < sh.journal.size(); ++j ) {
+							const leak *L = sh.leaks.find( sh.journal[j].first );
+							if( L && L->id == sh.journal[j].second ) all.push_back( L );
+						}
+					}
+#if kTraceyInbandHeaders
+					// headers are linked newest first, so older epochs are not visited
+					for( const header *h = sh.inband; h && in_epoch( h->record ); h = h->next ) {
+						all.push_back( &h->record );
+					}
+#endif
+				}
+				for( leaks::const_iterator it = all.begin(), end = all.end(); it != end; ++it ) {
+					const tracey::detail::leak &L = **it;
+					if( L.addr && L.size && in_epoch( L ) ) {
+						*wasted += L.bytes();
+						*found += L.count();
 						list.push_back( &L );
 					}
 				}
+				*found = counted( *found );
 				return list;
 			}
 
-			std::string _report() const {
+			typedef std::vector< std::pair< size_t, leak >, arena_allocator< std::pair< size_t, leak > > > survivors;
+
+			static bool by_id( const stamp &a, const stamp &b ) {
+				return a.second < b.second;
+			}
+			static bool by_position( const std::pair< size_t, leak > &a, const std::pair< size_t, leak > &b ) {
+				return a.first < b.first;
+			}
+
+			// records of given allocations (in id order) still live, by position in the list, copied out since records move.
+			// every lookup locks one shard only. in-band headers are found on the shard lists, down to the oldest id.
+			void alive( const stamp *list, size_t n, survivors &out ) {
+				sync();
+				for( size_t i = 0; i < n; ++i ) {
+					shard &sh = shard_of( list[i].first );
+					sh.mutex.lock();
+					const leak *L = sh.leaks.find( list[i].first );
+					if( L && L->id == list[i].second ) out.push_back( std::make_pair( i, *L ) );
+					sh.mutex.unlock();
+				}
+#if kTraceyInbandHeaders
+				for( unsigned i = 0; n && i < num_shards; ++i ) {
+					shards[i].mutex.lock();
+					for( const header *h = shards[i].inband; h && h->record.id >= list[0].second; h = h->next ) {
+						stamp key( h->record.addr, h->record.id );
+						const stamp *at = std::lower_bound( list, list + n, key, by_id );
+						if( at != list + n && *at == key ) out.push_back( std::make_pair( size_t( at - list ), h->record ) );
+					}
+					shards[i].mutex.unlock();
+				}
+				std::sort( out.begin(), out.end(), by_position );
+#endif
+			}
+
+			// live allocations merged by callstack, copied out of the registry. stack ids are resolved into frames while
+			// copying, so the copy stays valid after the registry moves on (ids are recycled once their last leak is freed).
+			struct live_set {
+				struct stack {
+					size_t bytes, count;  // count in allocations
+					size_t begin, end;    // range of frames
+				};
+				stats_t stats;
+				size_t wasted, found;     // bytes and allocations leaked
+				size_t listed, records;   // leak records, and all records
+				std::vector< stack > stacks;
+				std::vector< void * > frames;
+			};
+
+			// copies the live set out. all shards are locked meanwhile, but only to merge records and copy their frames:
+			// reports and dumps do everything else on the copy while other threads keep allocating.
+			void _snapshot( live_set &out ) {
+				typedef std::map< unsigned, tracey::branch, std::less< unsigned >, arena_allocator< std::pair< const unsigned, tracey::branch > > > branches;
+				branches unique;
+				std::vector< void * > frames;
+
+				lock_all();
+				out.stats = stats;
+				out.records = size();
+				leaks filtered = collect_leaks( &out.wasted, &out.found );
+				out.listed = filtered.size();
+				for( leaks::const_iterator it = filtered.begin(), end = filtered.end(); it != end; ++it ) {
+					tracey::branch &b = unique[ (*it)->stack ];
+					b.size += (*it)->bytes();
+					b.hits += (*it)->count();
+				}
+				filtered = leaks();
+				out.stacks.reserve( unique.size() );
+				for( branches::const_iterator it = unique.begin(), end = unique.end(); it != end; ++it ) {
+					stacks.frames( it->first, frames );
+					live_set::stack st = { size_t( it->second.size ), counted( it->second.hits ), out.frames.size(), 0 };
+					out.frames.insert( out.frames.end(), frames.begin(), frames.end() );
+					st.end = out.frames.size();
+					out.stacks.push_back( st );
+				}
+				unlock_all();
+			}
+
+			// writes a heap snapshot (see snapshot namespace). the registry is locked only while live stacks are copied:
+			// modules are listed before (the loader takes its own lock in there) and the file is written after.
+			bool _dump( const std::string &path ) {
+				snapshot::modules modules;
+				live_set live;
+				_snapshot( live );
+				const stats_t &st = live.stats;
+
+				snapshot::writer out;
+				out.data.assign( snapshot::magic, 8 );
+				out.u32( snapshot::version );
+				out.u32( sizeof(void *) );
+				out.u64( st.usage );
+				out.u64( st.usage_peak );
+				out.u64( st.num_leaks );
+				out.u64( st.leak_peak );
+				out.u64( st.overhead );
+				out.u64( st.sampling );
+				out.u32( uint32_t( modules.list.size() ) );
+				for( size_t i = 0; i < modules.list.size(); ++i ) {
+					out.str( modules.list[i].path );
+					out.str( modules.list[i].build_id );
+					out.u64( modules.list[i].bias );
+				}
+				out.u32( uint32_t( live.stacks.size() ) );
+				for( size_t i = 0; i < live.stacks.size(); ++i ) {
+					const live_set::stack &sk = live.stacks[i];
+					out.u64( sk.bytes );
+					out.u64( sk.count );
+					out.u32( uint32_t( sk.end - sk.begin ) );
+					for( size_t j = sk.begin; j < sk.end; ++j ) {
+						snapshot::frame f = modules.locate( live.frames[j] );
+						out.u32( f.module );
+						out.u64( f.offset );
+					}
+				}
+
+				kTraceyfFile *fp = kTraceyfOpen( path.c_str(), "wb" );
+				if( !fp ) {
+					return false;
+				}
+				bool ok = std::fwrite( out.data.data(), 1, out.data.size(), fp ) == out.data.size();
+				return ( kTraceyfClose( fp ) == 0 ) && ok;
+			}
+
+			// writes a report to a new temporary file, and returns its name
+			std::string _report() {
+				std::string logfile = get_temp_pathfile() + "xxx-tracey.html";
+				_report( logfile );
+				return logfile;
+			}
+
+#if kTraceyForkReports
+			std::vector< pid_t > children;
 
+			// writes a report from a forked child, which sees a frozen copy-on-write image of this process, and returns the
+			// name of the file the child is writing meanwhile. reports in process if fork() fails.
+			std::string _report_forked() {
+				for( size_t i = 0; i < children.size(); ) {
+					if( waitpid( children[i], 0, WNOHANG ) != 0 ) children.erase( children.begin() + i );
+					else ++i;
+				}
 				std::string logfile = get_temp_pathfile() + "xxx-tracey.html";
+				std::fflush( 0 ); // or buffered output would be written twice
+				pid_t pid = fork();
+				if( pid == 0 ) {
+					_report( logfile );
+					std::fflush( 0 );
+					_exit( 0 ); // no atexit handlers, nor a second report on exit
+				}
+				if( pid < 0 ) {
+					_report( logfile );
+				} else {
+					children.push_back( pid );
+				}
+				return logfile;
+			}
+#endif
 
+			// writes a report to given file
+			void _report( const std::string &logfile ) {
 				kTraceyPrintf( "%s", tracey::string( "<tracey/tracey.cpp> says: summary: \1" kTraceyCharLinefeed, stats.str() ).c_str() );
 				kTraceyPrintf( "%s", tracey::string( "<tracey/tracey.cpp> says: creating report: \1" kTraceyCharLinefeed, logfile).c_str() );
 				kTraceyfFile *fp = kTraceyfOpen( logfile.c_str(), "wb" );
+				if( fp ) {
+					sink out( write_file, fp );
+					_report( out, logfile );
+					out.flush();
+					kTraceyfClose( fp );
+				}
+			}
+
+			// streams a report into given sink. name is mentioned in the header, if any.
+			// the registry is only locked while its live set is copied (see _snapshot), not while symbols are resolved or text is written.
+			bool _report( sink &out, const std::string &name ) {
 
 				// this code often runs at the very end of a program cycle (even when static memory has been deallocated)
 				// so, avoid using global C++ objects like std::cout/cerr as much as possible; otherwise crashes may happen
@@ -3274,13 +6113,13 @@ namespace tracey
 
 				// Find leaks
 				kTraceyPrintf( "%s", tracey::string("<tracey/tracey.cpp> says: filtering leaks..." kTraceyCharLinefeed).c_str() );
-				size_t wasted, n_leak;
-				leaks filtered = collect_leaks( &wasted );
-				n_leak = filtered.size();
+				live_set live;
+				_snapshot( live );
+				size_t wasted = live.wasted, n_leak = live.found;
 				kTraceyPrintf( "%s", tracey::string("<tracey/tracey.cpp> says: found \1 leaks wasting \2" kTraceyCharLinefeed, n_leak, human(wasted)).c_str() );
 
 				// Calc score
-				double leaks_pct = this->size() ? n_leak * 100.0 / this->size() : 0.0;
+				double leaks_pct = live.records ? live.listed * 100.0 / live.records : 0.0;
 				std::string score = "perfect!";
 				if( leaks_pct >  0.00 ) score = "excellent";
 				if( leaks_pct >  1.25 ) score = "good";
@@ -3289,127 +6128,110 @@ namespace tracey
 				if (leaks_pct > 10.00 ) score = "lame";
 
 				// Header
-				kTraceyfPrintf( fp, "%s", tracey::string( "<html><body><xmp>" ).c_str() );
-				kTraceyfPrintf( fp, "%s", tracey::string( "<tracey/tracey.cpp> says: generated with \1 (\2)" kTraceyCharLinefeed, tracey::version(), tracey::url() ).c_str() );
+				out.write( tracey::string( "<html><body><xmp>" ) );
+				out.write( tracey::string( "<tracey/tracey.cpp> says: generated with \1 (\2)" kTraceyCharLinefeed, tracey::version(), tracey::url() ) );
 				if( tracey::lookup(url) == "????" )
-				kTraceyfPrintf( fp, "%s", tracey::string( "<tracey/tracey.cpp> says: failed to decode symbols!! Is debug information available?" $msvc(" Are .PDB files available?") kTraceyCharLinefeed ).c_str() );
-				kTraceyfPrintf( fp, "%s", tracey::string( "<tracey/tracey.cpp> says: best viewed on foldable text editor (like SublimeText2) with tabs=2sp and no word-wrap" kTraceyCharLinefeed ).c_str() );
-				kTraceyfPrintf( fp, "%s", tracey::string( "<tracey/tracey.cpp> says: \1, \2 leaks found; \3 wasted ('\4' score)" kTraceyCharLinefeed, !n_leak ? "ok" : "error", n_leak, human(wasted), score ).c_str() );
-				kTraceyfPrintf( fp, "%s", tracey::string( "<tracey/tracey.cpp> says: summary: \1" kTraceyCharLinefeed, stats.str() ).c_str() );
-				kTraceyfPrintf( fp, "%s", tracey::string( "<tracey/tracey.cpp> says: report filename: \1" kTraceyCharLinefeed, logfile).c_str() );
+				out.write( tracey::string( "<tracey/tracey.cpp> says: failed to decode symbols!! Is debug information available?" $msvc(" Are .PDB files available?") kTraceyCharLinefeed ) );
+				out.write( tracey::string( "<tracey/tracey.cpp> says: best viewed on foldable text editor (like SublimeText2) with tabs=2sp and no word-wrap" kTraceyCharLinefeed ) );
+				out.write( tracey::string( "<tracey/tracey.cpp> says: \1, \2 leaks found; \3 wasted ('\4' score)" kTraceyCharLinefeed, !n_leak ? "ok" : "error", n_leak, human(wasted), score ) );
+				out.write( tracey::string( "<tracey/tracey.cpp> says: summary: \1" kTraceyCharLinefeed, live.stats.str() ) );
+				if( !name.empty() )
+				out.write( tracey::string( "<tracey/tracey.cpp> says: report filename: \1" kTraceyCharLinefeed, name) );
 
 				// Body
-				// Get all frame addresses involved in all leaks
-				// Also, create a tree of frames; so we will take decisions from above by examining node weights (@todo)
+				// leaks sharing a callstack were merged by the snapshot, so every unique stack is inserted once, weighted by its leaks.
+				// a calling-context trie holds both branches: "begin" walks stacks from their outermost frame, "end" from their innermost.
 				kTraceyPrintf( "%s", tracey::string("<tracey/tracey.cpp> says: creating trees of frames..."  kTraceyCharLinefeed).c_str() );
-				std::set< void * > set;
-				tracey::tree tree;
-				tree[ (void *)((~0)-0) ]; // bottom-top branch
-				tree[ (void *)((~0)-1) ]; // top-bottom branch
-				for( leaks::const_iterator it = filtered.begin(), end = filtered.end(); it != end; ++it ) {
-					const leak &L = **it;
-					const tracey::callstack &callstack = L.cs;
-					tracey::tree *_tree = &tree[(void *)((~0)-0)];
-					tracey::tree *_tree_inv = &tree[(void *)((~0)-1)];
-					if( !callstack.frames.size() ) continue;
-
-					for( unsigned i = 0, start = kTraceyStacktraceSkipBegin, end = callstack.frames.size() - 1 - kTraceyStacktraceSkipEnd; start+i <= end; ++i ) {
-
-						double size;
-						size = (start+i == end ? L.size : 0);
-						(*_tree)[ callstack.frames[start + i] ].get().size += size;
-						(*_tree)[ callstack.frames[start + i] ].get().hits ++;
-						//(*_tree)[ callstack.frames[start + i] ].get().total = 100.0 * size / wasted;
-						_tree = &(*_tree)[ callstack.frames[start + i] ];
-						set.insert( callstack.frames[start + i] );
-
-						size = (end - i == start ? L.size : 0);
-						(*_tree_inv)[ callstack.frames[end - i] ].get().size += size;
-						(*_tree_inv)[ callstack.frames[end - i] ].get().hits ++;
-						//(*_tree_inv)[ callstack.frames[end - i] ].get().total = 100.0 * size / wasted;
-						_tree_inv = &(*_tree_inv)[ callstack.frames[end - i] ];
-						set.insert( callstack.frames[end - i] );
+				void *const begin = (void *)((~0)-1), *const end = (void *)((~0)-0);
+				trie calls;
+				unsigned top_down = calls.child( trie::root, begin ), bottom_up = calls.child( trie::root, end );
+				for( size_t s = 0; s < live.stacks.size(); ++s ) {
+					const live_set::stack &sk = live.stacks[s];
+					void *const *frames = live.frames.empty() ? 0 : &live.frames[ sk.begin ];
+					size_t depth = sk.end - sk.begin;
+					if( depth <= size_t( kTraceyStacktraceSkipBegin + kTraceyStacktraceSkipEnd ) ) continue;
+					unsigned first = kTraceyStacktraceSkipBegin, final = unsigned( depth - 1 - kTraceyStacktraceSkipEnd );
+					unsigned down = top_down, up = bottom_up;
+					for( unsigned i = 0; first + i <= final; ++i ) {
+						down = calls.child( down, frames[ final - i ] );
+						up = calls.child( up, frames[ first + i ] );
 					}
+					calls.nodes[ down ].size += sk.bytes, calls.nodes[ down ].hits += sk.count;
+					calls.nodes[ up ].size += sk.bytes, calls.nodes[ up ].hits += sk.count;
 				}
 
 				// Some apps are low on memory in here, so we free memory as soon as possible
-				filtered = leaks();
+				live = live_set();
+				calls.rollup();
 
-				if( !set.size() ) {
+				// unique frames
+				std::vector< void * > frames;
+				for( size_t i = 1; i < calls.nodes.size(); ++i ) {
+					if( calls.nodes[i].parent != trie::root ) frames.push_back( calls.nodes[i].frame );
+				}
+				std::sort( frames.begin(), frames.end() );
+				frames.erase( std::unique( frames.begin(), frames.end() ), frames.end() );
+
+				if( !frames.size() ) {
 					if( n_leak ) {
 						kTraceyPrintf( "%s", tracey::string("<tracey/tracey.cpp> says: error! failed to resolve symbols." $msvc(" Are PDB files available?") kTraceyCharLinefeed).c_str() );
 					}
 				} else {
-					kTraceyPrintf( "%s", tracey::string("<tracey/tracey.cpp> says: resolving \1 unique frames..." kTraceyCharLinefeed, set.size()).c_str() );
-					// convert set of unique frames into array of frames
+					kTraceyPrintf( "%s", tracey::string("<tracey/tracey.cpp> says: resolving \1 unique frames..." kTraceyCharLinefeed, frames.size()).c_str() );
 					tracey::callstack cs;
-					std::vector< void * > &frames = cs.frames;
-					frames.reserve( set.size() );
-					for( std::set< void * >::iterator it = set.begin(), end = set.end(); it != end; ++it ) {
-						frames.push_back( *it );
-					}
+					cs.frames.swap( frames );
 					tracey::strings symbols = cs.unwind();
-					std::map< void *, std::string > translate;
+					symbol_table translate;
 					{
-						if( frames.size() != symbols.size() ) {
-							kTraceyfPrintf( fp, "%s", tracey::string("<tracey/tracey.cpp> says: error! cannot resolve all frames (\1 vs \2)!" kTraceyCharLinefeed, frames.size(), symbols.size() ).c_str() );
-							for( unsigned i = 0, end = frames.size(); i < end; ++i ) {
-								translate[ frames[i] ] = tracey::string("\1", frames[i]);
+						if( cs.frames.size() != symbols.size() ) {
+							out.write( tracey::string("<tracey/tracey.cpp> says: error! cannot resolve all frames (\1 vs \2)!" kTraceyCharLinefeed, cs.frames.size(), symbols.size() ) );
+							for( unsigned i = 0, end = cs.frames.size(); i < end; ++i ) {
+								translate[ cs.frames[i] ] = tracey::string("\1", cs.frames[i]);
 							}
 						} else {
-							for( unsigned i = 0, end = frames.size(); i < end; ++i ) {
-								translate[ frames[i] ] = symbols[ i ];
+							for( unsigned i = 0, end = cs.frames.size(); i < end; ++i ) {
+								translate[ cs.frames[i] ] = symbols[ i ];
 							}
 						}
 
 						// Create a tree report, if possible
 						kTraceyPrintf( "%s", tracey::string("<tracey/tracey.cpp> says: converting tree of frames into tree of symbols..." kTraceyCharLinefeed).c_str() );
-						translate[ (void *)((~0)-1) ] = "begin";
-						translate[ (void *)((~0)-0) ] = "end";
-						tree.refresh();
-						//std::cout << tree << std::endl;
-
-						// truncate branches lower than user-defined percentage (it helps reducing log size)
-						// note: kTraceyTruncateBranchesSmallerThan defaults to 0% (~do not truncate branches, show all leaks)
-
-						kTraceyPrintf( "%s", tracey::string("<tracey/tracey.cpp> says: flattering tree of symbols..." kTraceyCharLinefeed).c_str() );
-						if( kTraceyTruncateBranchesSmallerThan > 0 ) {
-							tree.walk<tracey::chopper>();
-						}
+						translate[ begin ] = "begin";
+						translate[ end ] = "end";
 
+						// truncate branches lower than user-defined percentage (it helps reducing log size)
+						// note: kTraceyTruncateBranchesSmallerThan defaults to 0% (~do not truncate branches, show all leaks)
 						kTraceyPrintf( "%s", tracey::string("<tracey/tracey.cpp> says: dumping tree log..." kTraceyCharLinefeed).c_str() );
-						kTraceyfPrintf( fp, "%s", tracey::print(tree, wasted, translate, "{tabs}[{size}] ({value}) {key}\n", "{value}", true).c_str() );
+						print( out, calls, wasted, translate );
 					}
 				}
 
 				// Footer
-				kTraceyfPrintf( fp, "%s", tracey::string( "</xmp></body></html>" ).c_str() );
-				kTraceyfClose( fp );
+				out.write( tracey::string( "</xmp></body></html>" ) );
 
-				return logfile;
+				return out.flush();
 			}
 		};
 
 		void *tracer( void *ptr, size_t &size );
 
+#if kTraceyForkReports
+		void freeze_all();
+		void thaw_all();
+		void thaw_child();
+#endif
+
 		container &init() {
 			//static unsigned char buy[ sizeof( container ) ];
 			//static container *map = new (buy) container();
 			static $cpp11(std::unique_ptr) $cpp03(std::auto_ptr)<container> map( new container() );
 
 			static bool once = false; if(! once ) { once = true;
-				kTraceyPrintf( "%s", tracey::settings().c_str() );
-				if( 1 ) {
-					webmain( 0 );
-				}
-				if( 1 ) {
-					volatile bool sitdown = false;
-					std::thread(tracey::hotkeymain, (void *) &sitdown).detach();
-					while( !sitdown ) {
-					$windows( Sleep( 1000 ) );
-					$welse( sleep( 1 ) );
-					}
-				}
+				// settings, webserver and hotkeys are set up by a control thread, so the first allocation does not wait for them
+				std::thread( tracey::controlmain, (void *) 0 ).detach();
+#if kTraceyForkReports
+				pthread_atfork( freeze_all, thaw_all, thaw_child );
+#endif
 				// Construct internals of tracer (static initializers)
 				// size_t dummy = 0;
 				// tracer( 0, dummy );
@@ -3417,61 +6239,270 @@ namespace tracey
 			return *map;
 		}
 
-		void *tracer( void *ptr, size_t &size )
+#if kTraceyForkReports
+		// forked children (reports among them) find tracey as the forking thread left it, and own all its locks
+		void freeze_all() {
+			init().freeze();
+		}
+		void thaw_all() {
+			init().thaw();
+		}
+		void thaw_child() {
+			init().thaw();
+			heal::forked_symbolizer();
+		}
+#endif
+
+#if kTraceyAsyncTracking
+		static $tls(ring *) own = 0;
+		static $tls(bool) exited = false;
+
+		// flushes the ring of its thread on thread exit. events after that are tracked synchronously.
+		struct ring_owner {
+			container *map;
+			~ring_owner() {
+				acquired = true;
+				map->detach( own );
+				own = 0;
+				exited = true;
+				acquired = false;
+			}
+		};
+
+		ring *own_ring( container &map ) {
+			if( !own && !exited ) {
+				// c++03 has no thread exit hook. rings of exited threads are drained along with the others, but kept.
+				$cpp11( static thread_local ring_owner owner; owner.map = &map; )
+				own = map.attach();
+			}
+			return own;
+		}
+#endif
+
+		// tracey::thread_scope state of a thread. nested scopes share one journal of the allocations made meanwhile, in id order,
+		// and every scope owns the tail that starts at its entry. totals only grow, so a scope reads them at entry and later.
+		struct scoping {
+			struct level {
+				size_t begin, bytes, count;  // journal position and totals at entry
+			};
+			std::vector< level, arena_allocator< level > > levels;
+			stamps journal;
+			size_t bytes, count, limit;      // count in count_units
+
+			scoping() : bytes( 0 ), count( 0 ), limit( 64 )
+			{}
+
+			// drops stamps of freed allocations, and moves scope entries along
+			void compact( container &map ) {
+				container::survivors live;
+				map.alive( journal.data(), journal.size(), live );
+				size_t at = 0;
+				for( size_t i = 0; i < live.size(); ++i ) {
+					for( ; at < levels.size() && levels[ at ].begin <= live[i].first; ++at ) levels[ at ].begin = i;
+					journal[i] = journal[ live[i].first ];
+				}
+				for( ; at < levels.size(); ++at ) levels[ at ].begin = live.size();
+				journal.resize( live.size() );
+				limit = std::max( size_t( 64 ), live.size() * 2 );
+			}
+		};
+
+		// set while the thread is in a scope
+		static $tls(scoping *) scoped = 0;
+		static $tls(scoping *) own_scoping = 0;
+
+		// releases the scope state of its thread on thread exit
+		struct scoping_owner {
+			~scoping_owner() {
+				if( own_scoping ) {
+					own_scoping->~scoping();
+					metadata().deallocate( own_scoping, sizeof(scoping) );
+					own_scoping = scoped = 0;
+				}
+			}
+		};
+
+		scoping &own_scope() {
+			if( !own_scoping ) {
+				$cpp11( static thread_local scoping_owner owner; (void)owner; ) // c++03 keeps it until exit
+				own_scoping = new ( metadata().allocate( sizeof(scoping) ) ) scoping();
+			}
+			return *own_scoping;
+		}
+
+		// accounts a tracked allocation of calling thread to its scopes
+		void enscope( container &map, const void *ptr, size_t id, size_t size, float weight ) {
+			scoping &st = *scoped;
+			if( st.journal.size() >= st.limit ) {
+				st.compact( map );
+			}
+			st.journal.push_back( stamp( ptr, id ) );
+			st.bytes += scaled( size, weight );
+			st.count += scaled( count_unit, weight );
+		}
+
+		// admits a call into tracey: returns the registry and marks the thread as acquired, or null if the call is not tracked
+		container *enter( size_t size )
 		{
-			if( !ptr )
-				return size = 0, ptr;
+			// threads will return on recursive calls (tracey's own allocations) first, before any synchronization happens:
+			// every allocation tracey makes pays one thread-local read here and nothing else.
+			// registry locks are not recursive, so this check is also what keeps a thread from waiting on itself.
+
+			if( acquired )
+				return 0;
 
 			if( !kTraceyEnabledHard )                       // hard on/off switch
-				return size = 0, ptr;
+				return 0;
 
-			if( !kTraceyEnabledSoft && (size < (~0) - 4) )  // soft on/off switch; only for mallocs & frees
-				return size = 0, ptr;
+			if( !kTraceyEnabledSoft && (size < (~0) - 63) ) // soft on/off switch; only for mallocs & frees (special calls sit on top of the size range)
+				return 0;
 
 #if         kTraceyHookLegacyCRT
 			// do nothing
 #else
 			static bool initialized = true;
 			if( !initialized )
-				return size = 0, ptr;
+				return 0;
 			static container *init = 0;
 			static const bool reinit = (initialized = false, init = &tracey::init(), initialized = true);
-			static container &map = *init;
 #endif
 
-			if ( !mutex )
-				return size = 0, ptr;
+			if ( !ready )
+				return 0;
 
-			// threads will lock here till the slot is free.
-			// threads will return on recursive locks.
+			acquired = true;
+			return init;
+		}
+
+		// weight of an allocation about to be tracked, or 0 if sampling skips it (unsampled ones only count their bytes down)
+		float weigh( size_t size ) {
+			size_t interval = sampling_interval.load( std::memory_order_relaxed );
+			return interval ? sample( size, interval ) : 1;
+		}
+
+		// unwinding is the slowest part of tracking, so it is done before locking.
+		// frames are captured on the stack of calling thread, and only new traces are copied (into the depot).
+		unsigned capture( container &map ) {
+			void *frames[ tracey::callstack::max_frames ];
+			unsigned n = tracey::callstack::capture( frames, tracey::callstack::max_frames );
+			return map.stacks.intern( frames, n );
+		}
+
+		// tracey::no_alloc_zone state. zones of a thread are chained, innermost first, and every one of them records the
+		// allocations made meanwhile by callstack. every recorded site holds a reference to its stack.
+		struct zone_state {
+			int action;
+			size_t violations;
+			zone_state *outer;
+			std::vector< tracey::no_alloc_zone::site, arena_allocator< tracey::no_alloc_zone::site > > sites;
+		};
+
+		// set while the thread is in a zone
+		static $tls(zone_state *) zone = 0;
+		// last zone left, kept for the next one, so a zone around every iteration of a loop takes no allocation
+		static $tls(zone_state *) spare_zone = 0;
+
+		// releases the spare zone of its thread on thread exit
+		struct zone_owner {
+			~zone_owner() {
+				if( spare_zone ) {
+					spare_zone->~zone_state();
+					metadata().deallocate( spare_zone, sizeof(zone_state) );
+					spare_zone = 0;
+				}
+			}
+		};
+
+		// records an allocation made in a zone, into every zone of calling thread. the strictest action is taken once.
+		void violate( container &map, size_t size ) {
+			void *frames[ tracey::callstack::max_frames ];
+			unsigned n = tracey::callstack::capture( frames, tracey::callstack::max_frames );
+			int action = tracey::no_alloc_zone::count;
+			for( zone_state *z = zone; z; z = z->outer ) {
+				unsigned stack = map.stacks.intern( frames, n );
+				size_t i = 0;
+				while( i < z->sites.size() && z->sites[i].stack != stack ) ++i;
+				if( i < z->sites.size() ) {
+					map.stacks.release( stack );
+				} else {
+					tracey::no_alloc_zone::site s = { stack, 0, 0 };
+					z->sites.push_back( s );
+				}
+				z->sites[i].allocations++;
+				z->sites[i].bytes += size;
+				z->violations++;
+				action = std::max( action, z->action );
+			}
+			if( action >= tracey::no_alloc_zone::log ) {
+				kTraceyPrintf( "%s", (tracey::string( "<tracey/tracey.cpp> says: Error, allocation of \1 bytes in a no-alloc zone." kTraceyCharLinefeed, size ) +
+					tracey::callstack( true ).flat( kTraceyCharTab "\1) \2" kTraceyCharLinefeed, kTraceyStacktraceSkipBegin) ).c_str() );
+			}
+			if( action >= tracey::no_alloc_zone::abort ) {
+				acquired = false;
+				tracey::fail( "<tracey/tracey.cpp> says: Error, allocation in a no-alloc zone" );
+			}
+		}
+
+		// zones see every allocation, sampled or not, even while tracey is disabled
+		void zoned( size_t size ) {
+			container *entered = enter( ~size_t( 0 ) );
+			if( entered ) {
+				violate( *entered, size );
+				acquired = false;
+			}
+		}
 
-			static $tls(bool) acquired = false;
-			mutex->lock();
-			if( acquired ) {
-				mutex->unlock();
+		void *tracer( void *ptr, size_t &size )
+		{
+			if( !ptr )
 				return size = 0, ptr;
-			} else {
-				acquired = true;
+
+			if( zone && !acquired && size && size < size_t(~0) - 63 )
+				zoned( size );
+
+			if( counters && !acquired && ( size < size_t(~0) - 63 || size == ~size_t( 0 ) ) && tallied( size ) ) {
+				counted_blocks++;
+				return ptr;
 			}
 
-			// ready
-			container::iterator it = map.find( ptr );
-			bool found = ( it != map.end() );
+			container *entered = enter( size );
+			if( !entered )
+				return size = 0, ptr;
+
+			container &map = *entered;
+
+			// threads will lock here till the slot is free.
+			// only the shard that owns ptr is locked, unless the whole registry is involved.
 
 			if( size == ~0 || size == 0 )
 			{
+#if kTraceyAsyncTracking
+				// queued frees cannot tell wild pointers apart, so those are released as they are
+				map.post( own_ring( map ), ptr, 0, 0, 1 );
+				acquired = false;
+				return ptr;
+#endif
+				shard &sh = map.shard_of( ptr );
+				sh.mutex.lock();
+				leak *L = sh.leaks.find( ptr );
+				bool found = ( L != 0 );
+				unsigned stack = 0;
+
 				if( found )
 				{
-					leak &L = it->second;
-					stats.overhead -= L.cs.space();
-					stats.usage -= L.size;
-					stats.num_leaks--;
-					L.wipe();
+					stack = L->stack;
+					if( counters ) tally.freed += L->size;
+					if( in_epoch( *L ) ) stats.sub( map.lane_of( sh ), L->size, L->weight );
+					sh.leaks.erase( L );
 				}
-				else
+				sh.mutex.unlock();
+
+				map.stacks.release( stack );
+
+				if( !found )
 				{
-					// 1st) wild pointer deallocation found; warn user
-					if( kTraceyReportWildPointers )
+					// 1st) wild pointer deallocation found; warn user (unless sampling, where most pointers are untracked, or counting)
+					if( kTraceyReportWildPointers && !sampling_interval && !counted_free() )
 						kTraceyPrintf( "%s", (tracey::string( "<tracey/tracey.cpp> says: Error, wild pointer deallocation." kTraceyCharLinefeed ) +
 							tracey::callstack( true ).flat( kTraceyCharTab "\1) \2" kTraceyCharLinefeed, kTraceyStacktraceSkipBegin) ).c_str() );
 
@@ -3484,10 +6515,12 @@ namespace tracey
 			{
 				int code = *((int*)ptr);
 				//ptr = 0;
+				// queued events are applied first, so every opcode sees an exact registry (code 3 does nothing else)
+				map.sync();
 				if( code == 1 ) {
+					map.lock_all();
 					map._clear();
-					stats = stats_t();
-					timestamp_id = create_id();
+					map.unlock_all();
 				}
 
 				if( code == 2 ) { *((stats_t*)ptr) = stats; };
@@ -3499,7 +6532,12 @@ namespace tracey
 			{
 				static char placement[ sizeof(std::string) ];
 				static std::string *log = new ((std::string *)placement) std::string();
+				map.sync();
+#if kTraceyForkReports
+				*log = map._report_forked();
+#else
 				*log = map._report();
+#endif
 				ptr = (void *)log;
 			}
 			else
@@ -3513,43 +6551,174 @@ namespace tracey
 			{
 				static char placement[ sizeof(std::string) ];
 				static std::string *log = new ((std::string *)placement) std::string();
+				map.sync();
 				*log = stats.str();
 				ptr = (void *)log;
 			}
 			else
+			if( size == size_t(~0) - 5 )
+			{
+				map.sync();
+				ptr = map._dump( *((const std::string *)ptr) ) ? ptr : 0;
+			}
+			else
+			if( size == size_t(~0) - 6 )
 			{
+				map.sync();
+				ptr = map._report( *((sink *)ptr), std::string() ) ? ptr : 0;
+			}
+			else
+			{
+				kTraceyAssert( size > 0 );
+
+				// sampling: sampled allocations stand for the unsampled ones around them
+				float weight = weigh( size );
+				if( !weight ) {
+					acquired = false;
+					return ptr;
+				}
+
+				unsigned stack = capture( map );
+
+#if kTraceyAsyncTracking
+				size_t queued = map.post( own_ring( map ), ptr, size, stack, weight );
+				if( scoped ) enscope( map, ptr, queued, size, weight );
+				acquired = false;
+				return ptr;
+#endif
+
+				shard &sh = map.shard_of( ptr );
+				sh.mutex.lock();
+
+				// create a leak and (re)insert it into map
+				tracey::detail::leak *found = sh.leaks.find( ptr );
+				unsigned previous = 0;
+				if( found ) {
+					previous = found->stack;
+					if( in_epoch( *found ) ) stats.sub( map.lane_of( sh ), found->size, found->weight );
+				}
+				tracey::detail::leak &leak = found ? *found : sh.leaks.insert( ptr );
+				size_t id = leak.id = create_id();
+				sh.journal_add( ptr, id );
+				leak.stack = stack;
+				leak.size = size;
+				leak.weight = weight;
+
+				// update stats and peaks
+				stats.add( map.lane_of( sh ), size, weight );
+
+				sh.mutex.unlock();
+
+				if( scoped ) enscope( map, ptr, id, size, weight );
+
 				if( found ) {
+					map.stacks.release( previous );
 					if( kTraceyReportDoubleAllocations ) {
 						kTraceyPrintf( "%s", (tracey::string( "<tracey/tracey.cpp> says: Error, double pointer allocation. This should never happen" kTraceyCharLinefeed ) +
 							tracey::callstack( true ).flat( kTraceyCharTab "\1) \2" kTraceyCharLinefeed, kTraceyStacktraceSkipBegin) ).c_str() );
 					}
-					// kTraceyAssert( !map[ptr].first );
-					// kTraceyAssert( !map[ptr].second );
 				}
-				kTraceyAssert( size > 0 );
+			}
 
-				// create a leak and (re)insert it into map
-				tracey::detail::leak &leak = (map[ptr] = map[ptr]);
-				leak.wipe();
-				leak.cs.save();
-				leak.addr = ptr;
-				leak.size = size;
+			acquired = false;
 
-				// update stats
-				stats.num_leaks++;
-				stats.usage += size;
-				stats.overhead += leak.cs.space();
+			return ptr;
+		}
 
-				// and peaks
-				if( leak.size   > stats.leak_peak  ) stats.leak_peak = leak.size;
-				if( stats.usage > stats.usage_peak ) stats.usage_peak = stats.usage;
+#if kTraceyInbandHeaders
+		// operator new in in-band mode. every block gets a header, tracked or not, so operator delete can tell them apart.
+		void *inband_new( size_t size )
+		{
+			char *block = (char *)tracey::malloc( header::space() + size );
+			void *ptr = block + header::space();
+			header *h = header::of( ptr );
+			h->magic = h->sign( false );
+			h->record.size = size;
+
+			if( zone && !acquired )
+				zoned( size );
+
+			// in-band blocks have a header, so counting-only ones are told apart when freed and need no excuse
+			if( counters && !acquired && tallied( size ) )
+				return ptr;
+
+			container *entered = enter( size );
+			if( !entered )
+				return ptr;
+
+			container &map = *entered;
+			float weight = weigh( size );
+			if( weight ) {
+				leak &L = h->record;
+				new (&L) leak();
+				L.addr = ptr;
+				L.size = size;
+				L.weight = weight;
+				L.stack = capture( map );
+
+				shard &sh = map.shard_of( ptr );
+				sh.mutex.lock();
+				size_t id = L.id = create_id();
+				h->prev = 0;
+				h->next = sh.inband;
+				if( sh.inband ) sh.inband->prev = h;
+				sh.inband = h;
+				sh.inband_count++;
+				h->magic = h->sign( true );
+				stats.add( map.lane_of( sh ), size, weight );
+				stats.charge( map.lane_of( sh ), header::space() );
+				sh.mutex.unlock();
+				if( scoped ) enscope( map, ptr, id, size, weight );
 			}
 
 			acquired = false;
-			mutex->unlock();
-
 			return ptr;
 		}
+
+		// operator delete in in-band mode. pointers with no header (foreign ones) fall back to a registry lookup.
+		void inband_delete( void *ptr )
+		{
+			if( !ptr )
+				return;
+
+			header *h = header::of( ptr );
+			if( h->magic == h->sign( true ) ) {
+				if( counters && !acquired ) {
+					tally.frees++;
+					tally.freed += h->record.size;
+				}
+				// unlinking never allocates, so it is done even when tracey is disabled or acquired.
+				container &map = tracey::init();
+				shard &sh = map.shard_of( ptr );
+				unsigned stack = 0;
+				sh.mutex.lock();
+				if( h->magic == h->sign( true ) ) {
+					if( h->prev ) h->prev->next = h->next; else sh.inband = h->next;
+					if( h->next ) h->next->prev = h->prev;
+					sh.inband_count--;
+					stack = h->record.stack;
+					if( in_epoch( h->record ) ) stats.sub( map.lane_of( sh ), h->record.size, h->record.weight );
+					stats.charge( map.lane_of( sh ), 0 - header::space() );
+				}
+				h->magic = 0;
+				sh.mutex.unlock();
+				map.stacks.release( stack );
+				tracey::free( h->block() );
+			}
+			else
+			if( h->magic == h->sign( false ) ) {
+				if( counters && !acquired ) {
+					tally.frees++;
+					tally.freed += h->record.size;
+				}
+				h->magic = 0;
+				tracey::free( h->block() );
+			}
+			else {
+				tracey::free( tracey::forget( ptr ) );
+			}
+		}
+#endif
 	};
 }
 
@@ -3570,13 +6739,31 @@ namespace tracey
 	void disable() {
 		kTraceyEnabledSoft = false;
 	}
+	void sampling( size_t bytes ) {
+		sampling_interval = bytes;
+	}
 	void clear() {
 		size_t opcode = 1, special_fn = (~0) - 1;
 		tracer( &opcode, special_fn );
 	}
+	static void sync() {
+		size_t opcode = 3, special_fn = (~0) - 1;
+		tracer( &opcode, special_fn );
+	}
+	// special calls return a string of tracey, unless tracey is not running (then size is zeroed and ptr is returned)
 	std::string report() {
+		std::string none;
 		size_t special_fn = (~0) - 2;
-		return *((std::string *)tracey::tracer( (void*)&report, special_fn ));
+		void *log = tracey::tracer( (void *)&none, special_fn );
+		return special_fn ? *((std::string *)log) : none;
+	}
+	bool report( writer fn, void *user ) {
+		sink out( fn, user );
+		size_t special_fn = (~0) - 6;
+		return tracey::tracer( (void *)&out, special_fn ) != 0 && special_fn != 0; // size is zeroed when tracey is not running
+	}
+	bool report( FILE *fp ) {
+		return fp && report( write_stream, fp ) && std::fflush( fp ) == 0;
 	}
 	void view( const std::string &report ) {
 		std::string copy = report;
@@ -3584,8 +6771,117 @@ namespace tracey
 		tracer( &copy, special_fn );
 	}
 	std::string summary() {
+		std::string none;
 		size_t special_fn = (~0) - 4;
-		return *((std::string *)tracey::tracer( (void*)&report, special_fn ));
+		void *log = tracey::tracer( (void *)&none, special_fn );
+		return special_fn ? *((std::string *)log) : none;
+	}
+	bool dump( const std::string &path ) {
+		size_t special_fn = (~0) - 5;
+		return tracey::tracer( (void *)&path, special_fn ) != 0 && special_fn != 0; // size is zeroed when tracey is not running
+	}
+	static std::string hex( uint64_t value ) {
+		char buf[ 32 ];
+		std::sprintf( buf, "0x%llx", (unsigned long long)value );
+		return buf;
+	}
+	std::string render( const std::string &path, const std::string &debug_dir ) {
+		std::string data;
+		if( kTraceyfFile *fp = kTraceyfOpen( path.c_str(), "rb" ) ) {
+			char buf[ 64 * 1024 ];
+			for( size_t len; ( len = std::fread( buf, 1, sizeof(buf), fp ) ) > 0; ) data.append( buf, len );
+			kTraceyfClose( fp );
+		}
+		snapshot::reader in( data );
+		char magic[ 8 ];
+		in.raw( magic, 8 );
+		if( !in.ok || std::memcmp( magic, snapshot::magic, 8 ) || in.u32() != snapshot::version || in.u32() != sizeof(void *) ) {
+			return std::string();
+		}
+		stats_t st;
+		st.usage = size_t( in.u64() );
+		st.usage_peak = size_t( in.u64() );
+		st.num_leaks = size_t( in.u64() );
+		st.leak_peak = size_t( in.u64() );
+		st.overhead = size_t( in.u64() );
+		st.sampling = size_t( in.u64() );
+		std::vector< snapshot::module > modules;
+		for( uint32_t i = 0, n = in.u32(); i < n && in.ok; ++i ) {
+			snapshot::module m;
+			m.path = in.str();
+			m.build_id = in.str();
+			m.bias = uintptr_t( in.u64() );
+			modules.push_back( m );
+		}
+		std::vector< snapshot::stack > stacks;
+		for( uint32_t i = 0, n = in.u32(); i < n && in.ok; ++i ) {
+			snapshot::stack s;
+			s.bytes = in.u64();
+			s.count = in.u64();
+			for( uint32_t j = 0, depth = in.u32(); j < depth && in.ok; ++j ) {
+				snapshot::frame f;
+				f.module = in.u32();
+				f.offset = in.u64();
+				s.frames.push_back( f );
+			}
+			stacks.push_back( s );
+		}
+		if( !in.ok ) {
+			return std::string();
+		}
+		std::sort( stacks.begin(), stacks.end() );
+
+		// every module is symbolized in one go, from the first file that matches its build-id:
+		// a debug file or a copy of the module in debug_dir, the module path itself, or the system debug files
+		std::vector< std::map< uint64_t, std::string > > symbols( modules.size() );
+		for( size_t i = 0; i < stacks.size(); ++i ) {
+			for( size_t j = 0; j < stacks[i].frames.size(); ++j ) {
+				const snapshot::frame &f = stacks[i].frames[j];
+				if( f.module < modules.size() ) symbols[ f.module ][ f.offset ];
+			}
+		}
+		for( size_t m = 0; m < modules.size(); ++m ) {
+			if( symbols[m].empty() ) continue;
+			const std::string &id = modules[m].build_id, &file = modules[m].path;
+			std::string name = file.substr( file.find_last_of( '/' ) + 1 ), debug_id = id.size() > 2 ? id.substr( 0, 2 ) + "/" + id.substr( 2 ) + ".debug" : std::string();
+			std::vector< std::string > candidates;
+			if( !debug_dir.empty() && !debug_id.empty() ) candidates.push_back( debug_dir + "/.build-id/" + debug_id );
+			if( !debug_dir.empty() ) candidates.push_back( debug_dir + "/" + name );
+			candidates.push_back( file );
+			if( !debug_id.empty() ) candidates.push_back( "/usr/lib/debug/.build-id/" + debug_id );
+
+			std::vector< uintptr_t > offsets;
+			for( std::map< uint64_t, std::string >::iterator it = symbols[m].begin(); it != symbols[m].end(); ++it ) {
+				offsets.push_back( uintptr_t( it->first ) );
+			}
+			std::vector< std::string > texts;
+			for( size_t c = 0; c < candidates.size(); ++c ) {
+				if( heal::symbolize( candidates[c], id, offsets, texts ) ) break;
+			}
+			size_t k = 0;
+			for( std::map< uint64_t, std::string >::iterator it = symbols[m].begin(); it != symbols[m].end(); ++it, ++k ) {
+				it->second = k < texts.size() && !texts[k].empty() ? texts[k] : name + "+" + hex( it->first );
+			}
+		}
+
+		uint64_t bytes = 0, count = 0;
+		for( size_t i = 0; i < stacks.size(); ++i ) {
+			bytes += stacks[i].bytes;
+			count += stacks[i].count;
+		}
+		std::string out;
+		out += tracey::string( "<tracey/tracey.cpp> says: snapshot: \1" kTraceyCharLinefeed, path );
+		out += tracey::string( "<tracey/tracey.cpp> says: summary: \1" kTraceyCharLinefeed, st.str() );
+		out += tracey::string( "<tracey/tracey.cpp> says: \1 allocs in use from \2 callstacks, \3" kTraceyCharLinefeed, count, stacks.size(), human( size_t( bytes ) ) );
+		for( size_t i = 0; i < stacks.size(); ++i ) {
+			out += tracey::string( "[\1] (\2 allocs)" kTraceyCharLinefeed, human( size_t( stacks[i].bytes ) ), stacks[i].count );
+			for( size_t j = 0; j < stacks[i].frames.size(); ++j ) {
+				const snapshot::frame &f = stacks[i].frames[j];
+				std::string text = f.module < modules.size() ? symbols[ f.module ][ f.offset ] : hex( f.offset );
+				out += tracey::string( kTraceyCharTab "#\1 \2" kTraceyCharLinefeed, j, text );
+			}
+		}
+		return out;
 	}
 	void fail( const char *message ) {
 		kTraceyPrintf( "%s\n", message );
@@ -3629,10 +6925,17 @@ namespace tracey
 		out += tracey::string( "\1with C++ exceptions=\2" kTraceyCharLinefeed, prefix, $throw("enabled") $telse("disabled") );
 		out += tracey::string( "\1with kTraceyBudgetOverhead=\2%" kTraceyCharLinefeed, prefix, (100 + kTraceyBudgetOverhead) );
 		out += tracey::string( "\1with kTraceyMaxStacktraces=\2 range[\3..\4]" kTraceyCharLinefeed, prefix, int(kTraceyMaxStacktraces), int(kTraceyStacktraceSkipBegin), int(kTraceyStacktraceSkipEnd) );
+		out += tracey::string( "\1with kTraceyUnwinder=\2" kTraceyCharLinefeed, prefix, int(kTraceyUnwinder) );
+		out += tracey::string( "\1with kTraceySamplingInterval=\2" kTraceyCharLinefeed, prefix, size_t(kTraceySamplingInterval) );
 		// kTraceyCharLinefeed
 		// kTraceyCharTab
 		out += tracey::string( "\1with kTraceyReportWildPointers=\2" kTraceyCharLinefeed, prefix, kTraceyReportWildPointers ? "yes" : "no" );
 		out += tracey::string( "\1with kTraceyDefineMemoryOperators=\2" kTraceyCharLinefeed, prefix, kTraceyDefineMemoryOperators ? "yes" : "no" );
+		out += tracey::string( "\1with kTraceyInbandHeaders=\2" kTraceyCharLinefeed, prefix, kTraceyInbandHeaders ? "yes" : "no" );
+		out += tracey::string( "\1with kTraceySpinlocks=\2" kTraceyCharLinefeed, prefix, kTraceySpinlocks ? "yes" : "no" );
+		out += tracey::string( "\1with kTraceySymbolCache=\2" kTraceyCharLinefeed, prefix, kTraceySymbolCache[0] ? kTraceySymbolCache : "no" );
+		out += tracey::string( "\1with kTraceySymbolizerThreads=\2" kTraceyCharLinefeed, prefix, kTraceySymbolizerThreads );
+		out += tracey::string( "\1with kTraceyForkReports=\2" kTraceyCharLinefeed, prefix, kTraceyForkReports ? "yes" : "no" );
 		out += tracey::string( "\1with kTraceyMemsetAllocations=\2" kTraceyCharLinefeed, prefix, kTraceyMemsetAllocations ? "yes" : "no" );
 		out += tracey::string( "\1with kTraceyStacktraceSkipBegin=\2" kTraceyCharLinefeed, prefix, int(kTraceyStacktraceSkipBegin) );
 		out += tracey::string( "\1with kTraceyStacktraceSkipEnd=\2" kTraceyCharLinefeed, prefix, int(kTraceyStacktraceSkipEnd) );
@@ -3696,7 +6999,45 @@ namespace tracey
 	}
 }
 
-#if kTraceyDefineMemoryOperators
+#if kTraceyDefineMemoryOperators && kTraceyInbandHeaders
+
+//* Custom memory operators (with no exceptions)
+
+void *operator new( size_t size, const std::nothrow_t &t ) throw() {
+	return tracey::inband_new( size );
+}
+
+void *operator new[]( size_t size, const std::nothrow_t &t ) throw() {
+	return tracey::inband_new( size );
+}
+
+void operator delete( void *ptr, const std::nothrow_t &t ) throw() {
+	tracey::inband_delete( ptr );
+}
+
+void operator delete[]( void *ptr, const std::nothrow_t &t ) throw() {
+	tracey::inband_delete( ptr );
+}
+
+//* Custom memory operators (with exceptions)
+
+void *operator new( size_t size ) throw(std::bad_alloc) {
+	return tracey::inband_new( size );
+}
+
+void *operator new[]( size_t size ) throw(std::bad_alloc) {
+	return tracey::inband_new( size );
+}
+
+void operator delete( void *ptr ) throw() {
+	tracey::inband_delete( ptr );
+}
+
+void operator delete[]( void *ptr ) throw() {
+	tracey::inband_delete( ptr );
+}
+
+#elif kTraceyDefineMemoryOperators
 
 //* Custom memory operators (with no exceptions)
 
@@ -3811,10 +7152,7 @@ static void webmain( void *arg )
 
 namespace tracey {
 	#pragma comment(lib, "user32.lib")
-	static void hotkeymain( void *arg ) {
-		volatile bool &sitdown = *(volatile bool *)arg;
-		sitdown = true;
-
+	static void hotkeymain( void * ) {
 		$windows(
 			for(;;) {
 				if( GetAsyncKeyState(VK_NUMLOCK) ) {
@@ -3824,6 +7162,29 @@ namespace tracey {
 			}
 		)
 	}
+
+	static void controlmain( void * ) {
+		// symbol lookups and sockets are tracey's own work, so they are not tracked
+		acquired = true;
+		kTraceyPrintf( "%s", tracey::settings().c_str() );
+		webmain( 0 );
+		acquired = false;
+
+		// reports are requested from here, so this thread is tracked again
+		hotkeymain( 0 );
+	}
+
+	// helper threads of tracey's own work (like symbolization workers) never track their allocations
+	void untracked_thread() {
+		acquired = true;
+	}
+
+	void *allocate_metadata( size_t bytes ) {
+		return metadata().allocate( bytes );
+	}
+	void release_metadata( void *ptr, size_t bytes ) {
+		metadata().deallocate( ptr, bytes );
+	}
 }
 
 // platform related, externals here.
@@ -3846,7 +7207,178 @@ namespace tracey {
 	}
 	scope::~scope() {
 		tracey::disable();
-		if( tracey::stats.num_leaks > 0 ) tracey::view( tracey::report() );
+		tracey::sync();
+		if( stats_t( tracey::stats ).num_leaks > 0 ) tracey::view( tracey::report() );
+	}
+
+	thread_scope::thread_scope() {
+		scoping &st = own_scope();
+		scoping::level entry = { st.journal.size(), st.bytes, st.count };
+		st.levels.push_back( entry );
+		depth = st.levels.size() - 1;
+		scoped = &st;
+	}
+	thread_scope::~thread_scope() {
+		scoping &st = *own_scoping;
+		st.levels.resize( depth );
+		if( st.levels.empty() ) {
+			st.journal.clear();
+			st.limit = 64;
+			scoped = 0;
+		}
+	}
+	static bool by_stack( const thread_scope::site &a, const thread_scope::site &b ) {
+		return a.stack < b.stack;
+	}
+	static bool by_bytes( const thread_scope::site &a, const thread_scope::site &b ) {
+		return a.bytes != b.bytes ? a.bytes > b.bytes : a.stack < b.stack;
+	}
+	thread_scope::usage_t thread_scope::usage() const {
+		// admitted like a special call, so it works while tracey is disabled. empty if tracey is not running.
+		usage_t u = usage_t();
+		container *map = enter( ~size_t( 0 ) );
+		if( !map ) return u;
+		const scoping &st = *own_scoping;
+		const scoping::level &entry = st.levels[ depth ];
+		container::survivors live;
+		map->alive( st.journal.data() + entry.begin, st.journal.size() - entry.begin, live );
+		acquired = false;
+
+		// survivors merged by callstack (counts in count_units until the end)
+		std::vector< site, arena_allocator< site > > sites;
+		for( size_t i = 0; i < live.size(); ++i ) {
+			site s = { live[i].second.stack, live[i].second.bytes(), live[i].second.count() };
+			sites.push_back( s );
+		}
+		std::sort( sites.begin(), sites.end(), by_stack );
+		size_t n = 0, count = 0;
+		for( size_t i = 0; i < sites.size(); ++i ) {
+			u.surviving += sites[i].bytes;
+			count += sites[i].count;
+			if( n && sites[ n - 1 ].stack == sites[i].stack ) {
+				sites[ n - 1 ].bytes += sites[i].bytes;
+				sites[ n - 1 ].count += sites[i].count;
+			} else {
+				sites[ n++ ] = sites[i];
+			}
+		}
+		sites.resize( n );
+		std::sort( sites.begin(), sites.end(), by_bytes );
+		for( size_t i = 0; i < n; ++i ) {
+			sites[i].count = counted( sites[i].count );
+		}
+
+		u.allocated = st.bytes - entry.bytes;
+		u.allocations = counted( st.count - entry.count );
+		u.survivors = counted( count );
+		u.freed = u.allocated - u.surviving;
+		u.frees = u.allocations - u.survivors;
+		u.sites.assign( sites.begin(), sites.end() );
+		return u;
+	}
+
+	counter::counter( bool counting_only ) : counting_only( counting_only ) {
+		counters++;
+		if( counting_only && !counting++ ) {
+			counted_blocks = unmatched_frees = 0;
+		}
+		entry = tally;
+	}
+	counter::~counter() {
+		counters--;
+		if( counting_only && !--counting && counted_blocks > unmatched_frees ) {
+			escaped += counted_blocks - unmatched_frees;
+		}
+	}
+	counter::totals counter::read() const {
+		totals now = tally;
+		now.allocations -= entry.allocations;
+		now.allocated -= entry.allocated;
+		now.frees -= entry.frees;
+		now.freed -= entry.freed;
+		return now;
+	}
+	void counter::reset() {
+		entry = tally;
+	}
+	double counter::allocations_per( size_t iterations ) const {
+		return iterations ? double( read().allocations ) / iterations : 0;
+	}
+	double counter::bytes_per( size_t iterations ) const {
+		return iterations ? double( read().allocated ) / iterations : 0;
+	}
+
+	static void *enter_zone( int action ) {
+		zone_state *z = spare_zone;
+		if( z ) {
+			spare_zone = 0;
+		} else {
+			$cpp11( static thread_local zone_owner owner; (void)owner; ) // c++03 keeps it until exit
+			z = new ( metadata().allocate( sizeof(zone_state) ) ) zone_state();
+		}
+		z->action = action;
+		z->violations = 0;
+		z->outer = zone;
+		zone = z;
+		return z;
+	}
+	static size_t leave_zone( void *state ) {
+		zone_state *z = (zone_state *)state;
+		size_t violations = z->violations;
+		zone = z->outer;
+		for( size_t i = 0; i < z->sites.size(); ++i ) {
+			init().stacks.release( z->sites[i].stack );
+		}
+		z->sites.clear();
+		if( !spare_zone ) {
+			spare_zone = z;
+		} else {
+			z->~zone_state();
+			metadata().deallocate( z, sizeof(zone_state) );
+		}
+		return violations;
+	}
+	static bool more_allocations( const no_alloc_zone::site &a, const no_alloc_zone::site &b ) {
+		return a.allocations != b.allocations ? a.allocations > b.allocations : a.bytes > b.bytes;
+	}
+	// the zone is suspended meanwhile, so the report does not report itself
+	static std::string zone_report( void *state ) {
+		zone_state *z = (zone_state *)state, *active = zone;
+		zone = 0;
+		std::vector< no_alloc_zone::site > sites( z->sites.begin(), z->sites.end() );
+		std::sort( sites.begin(), sites.end(), more_allocations );
+		std::string out = tracey::string( "<tracey/tracey.cpp> says: \1 allocations in no-alloc zone, from \2 sites" kTraceyCharLinefeed, z->violations, sites.size() );
+		std::vector< void * > frames;
+		for( size_t i = 0; i < sites.size(); ++i ) {
+			tracey::callstack cs;
+			init().stacks.frames( sites[i].stack, frames );
+			cs.frames.assign( frames.begin(), frames.end() );
+			out += tracey::string( "[\1] \2 allocations, \3" kTraceyCharLinefeed, i + 1, sites[i].allocations, tracey::human( sites[i].bytes ) );
+			out += cs.flat( kTraceyCharTab "\1) \2" kTraceyCharLinefeed, kTraceyStacktraceSkipBegin );
+		}
+		zone = active;
+		return out;
+	}
+
+	no_alloc_zone::no_alloc_zone( action on_violation ) : state( enter_zone( on_violation ) )
+	{}
+	no_alloc_zone::~no_alloc_zone() {
+		leave_zone( state );
+	}
+	size_t no_alloc_zone::violations() const {
+		return ((const zone_state *)state)->violations;
+	}
+	std::vector< no_alloc_zone::site > no_alloc_zone::sites() const {
+		const zone_state *z = (const zone_state *)state;
+		zone_state *active = zone;
+		zone = 0;
+		std::vector< site > out( z->sites.begin(), z->sites.end() );
+		std::sort( out.begin(), out.end(), more_allocations );
+		zone = active;
+		return out;
+	}
+	std::string no_alloc_zone::report() const {
+		return zone_report( state );
 	}
 }
 
@@ -3865,6 +7397,9 @@ extern "C" {
 		void  tracey_disable() {
 			tracey::disable();
 		}
+		void  tracey_sampling( size_t bytes ) {
+			tracey::sampling( bytes );
+		}
 		void  tracey_clear() {
 			return tracey::clear();
 		}
@@ -3893,6 +7428,18 @@ extern "C" {
 		void  tracey_view_report() {
 			tracey::view( tracey::report() );
 		}
+		int   tracey_dump( const char *path ) {
+			return tracey::dump( path );
+		}
+		int   tracey_report_to( int (*writer)( const char *data, size_t len, void *user ), void *user ) {
+			return tracey::report( writer, user );
+		}
+		int   tracey_report_file( FILE *fp ) {
+			return tracey::report( fp );
+		}
+		int   tracey_report_fd( int fd ) {
+			return tracey::report( tracey::write_fd, &fd );
+		}
 
 		// Unchecked memory API
 		void *tracey_unchecked_amalloc( size_t size, size_t alignment ) {
@@ -3928,6 +7475,20 @@ extern "C" {
 			tracey::free( tracey::forget( ptr ) );
 		}
 
+		// Allocation-free zones
+		void  tracey_no_alloc_begin( int action ) {
+			tracey::enter_zone( action );
+		}
+		size_t tracey_no_alloc_violations() {
+			return tracey::zone ? tracey::zone->violations : 0;
+		}
+		char *tracey_no_alloc_report() {
+			return tracey::zone ? strdup( tracey::zone_report( tracey::zone ).c_str() ) : 0;
+		}
+		size_t tracey_no_alloc_end() {
+			return tracey::zone ? tracey::leave_zone( tracey::zone ) : 0;
+		}
+
 		// Crash API
 		void tracey_fail( const char *message ) {
 			tracey::fail( message );
@@ -21,6 +21,10 @@
 /*/ #define kTraceyStacktraceSkipBegin         0
 /*/ Tracey tail position on every stacktrace. It does not skip backtraces by default.
 /*/ #define kTraceyStacktraceSkipEnd           0
+/*/ Tracey unwinder. 0: system (backtrace/RtlCaptureStackBackTrace), 1: frame pointers (faster; build with -fno-omit-frame-pointer, x86/x64/arm64 linux/osx), 2: cached DWARF CFI (x64 linux)
+/*/ #define kTraceyUnwinder                    0
+/*/ When >0, Tracey samples about one allocation every N bytes (poisson) and scales reports back to estimates; else it tracks all of them. See tracey::sampling()
+/*/ #define kTraceySamplingInterval            0
 /*/ Tracey linefeed character when logging.
 /*/ #define kTraceyCharLinefeed                "\n"
 /*/ Tracey tab character when logging.
@@ -43,6 +47,22 @@
 /*/ #define kTraceyTruncateBranchesSmallerThan 0.0 
 /*/ When enabled, Tracey implements all new/delete operators; else user must use runtime API manually (see below).
 /*/ #define kTraceyDefineMemoryOperators       1
+/*/ Tracey splits its registry of allocations into this many address-hashed shards, each one with its own lock (1 = single global lock)
+/*/ #define kTraceyRegistryShards              64
+/*/ When enabled, Tracey queues allocations into per-thread rings that a background thread applies to the registry. Note: requires C++11
+/*/ #define kTraceyAsyncTracking               0
+/*/ Tracey per-thread ring capacity, in events (power of two). Used by async tracking only.
+/*/ #define kTraceyAsyncRingSize               4096
+/*/ When enabled, Tracey operators new/delete keep every record in a header right before the allocated block, so deletions need no registry lookup. Note: requires kTraceyDefineMemoryOperators
+/*/ #define kTraceyInbandHeaders               0
+/*/ When enabled, Tracey locks its registry shards with spinlocks (spin, then yield) instead of mutexes. Note: requires C++11
+/*/ #define kTraceySpinlocks                   0
+/*/ When not empty, Tracey keeps resolved symbols in this directory, one append-only file per module build-id, and reuses them on later reports and runs (linux)
+/*/ #define kTraceySymbolCache                 ""
+/*/ Tracey resolves symbols of big reports on this many threads, split by module and line sequence (0 = all cores). Note: requires C++11
+/*/ #define kTraceySymbolizerThreads           0
+/*/ When enabled, tracey::report() forks, and the child writes the report from a frozen copy-on-write image of the process while the parent goes on (posix)
+/*/ #define kTraceyForkReports                 0
 
 /*/ Backend implementation. Tweak these if needed.
 /*/
@@ -77,6 +97,7 @@
 #ifdef __cplusplus
 
 #include <string>
+#include <vector>
 
 namespace tracey {
 
@@ -87,11 +108,17 @@ namespace tracey {
     void  enable();
     void  disable();
     void  clear();
+    void  sampling( size_t bytes );
 
     /*/ Report API
     /*/
+    typedef int (*writer)( const char *data, size_t len, void *user ); // returns 0 to stop
     std::string report();
+    bool report( writer fn, void *user );
+    bool report( FILE *fp );
     void view( const std::string &report );
+    bool dump( const std::string &path );
+    std::string render( const std::string &dump, const std::string &debug_dir = std::string() );
 
     /*/ Unchecked memory API
     /*/
@@ -121,6 +148,55 @@ namespace tracey {
         private: scope( const scope & );
         private: scope& operator=( const scope & ) const;
     };
+
+    /*/ RAII based monitoring of calling thread: allocations it makes meanwhile (nested scopes included)
+    /*/
+    struct thread_scope {
+        struct site { unsigned stack; size_t bytes, count; };
+        struct usage_t {
+            size_t allocated, allocations;  // made in scope
+            size_t freed, frees;            // of those, freed since (on any thread)
+            size_t surviving, survivors;    // of those, still live
+            std::vector<site> sites;        // survivors by callstack id, heaviest first
+        };
+         thread_scope();
+        ~thread_scope();
+        usage_t usage() const;              // from the thread that entered the scope
+        private: size_t depth;
+        private: thread_scope( const thread_scope & );
+        private: thread_scope& operator=( const thread_scope & ) const;
+    };
+
+    /*/ Allocation-free zones: allocations made by calling thread meanwhile are violations, recorded by callstack (nested zones too)
+    /*/
+    struct no_alloc_zone {
+        enum action { count, log, abort };      // on violation: record it; also print its callstack; also fail()
+        struct site { unsigned stack; size_t allocations, bytes; };
+        explicit no_alloc_zone( action on_violation = count );
+        ~no_alloc_zone();
+        size_t violations() const;
+        std::vector<site> sites() const;        // offending sites, most frequent first
+        std::string report() const;             // offending sites and their callstacks
+        private: void *state;
+        private: no_alloc_zone( const no_alloc_zone & );
+        private: no_alloc_zone& operator=( const no_alloc_zone & ) const;
+    };
+
+    /*/ Allocation counting of calling thread (nested counters too), for benchmark loops: no callstacks and no reports
+    /*/
+    struct counter {
+        struct totals { size_t allocations, allocated, frees, freed; };  // freed: bytes of the frees tracey can size
+        explicit counter( bool counting_only = true );   // counting-only: allocations meanwhile are counted but not tracked
+        ~counter();
+        totals read() const;                              // since entry or last reset()
+        void reset();
+        double allocations_per( size_t iterations ) const;
+        double bytes_per( size_t iterations ) const;
+        private: totals entry;
+        private: bool counting_only;
+        private: counter( const counter & );
+        private: counter& operator=( const counter & ) const;
+    };
 }
 
 extern "C" {
@@ -133,6 +209,7 @@ extern "C" {
     void  tracey_enable();
     void  tracey_disable();
     void  tracey_clear();
+    void  tracey_sampling( size_t bytes );
 
     /*/ Information API   -----  [!!] free() return value after use [!!]
     /*/
@@ -146,6 +223,10 @@ extern "C" {
     /*/
     void  tracey_view( const char *const report );
     void  tracey_view_report();
+    int   tracey_dump( const char *path );
+    int   tracey_report_to( int (*writer)( const char *data, size_t len, void *user ), void *user );
+    int   tracey_report_file( FILE *fp );
+    int   tracey_report_fd( int fd );
 
     /*/ Checked memory API 
     /*/
@@ -163,6 +244,13 @@ extern "C" {
     void  tracey_unchecked_free( void *ptr );
     void *tracey_unchecked_amalloc( size_t size, size_t alignment );
 
+    /*/ Allocation-free zones (action: 0 count, 1 log, 2 abort) -----  [!!] free() report after use [!!]
+    /*/
+    void   tracey_no_alloc_begin( int action );
+    size_t tracey_no_alloc_violations();
+    char  *tracey_no_alloc_report();
+    size_t tracey_no_alloc_end();
+
     /*/ Crash API 
     /*/
     void tracey_fail( const char *message );